@@ -1,13 +1,17 @@
 #pragma once
 
 #include "arc/arc/all.hpp"
+#include "arc/arc/cancelled.hpp"
 #include "arc/arc/context.hpp"
 #include "arc/arc/coro.hpp"
+#include "arc/arc/frame_counters.hpp"
 #include "arc/arc/funnel.hpp"
 #include "arc/arc/future.hpp"
 #include "arc/arc/options.hpp"
 #include "arc/arc/promise_proxy.hpp"
 #include "arc/arc/result.hpp"
 #include "arc/arc/task.hpp"
+#include "arc/arc/this_coro.hpp"
+#include "arc/arc/timer.hpp"
 
 #include "arc/impl/arc.ipp"
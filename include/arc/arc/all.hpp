@@ -1,12 +1,18 @@
 #pragma once
 
+#include "arc/arc/cancelled.hpp"
 #include "arc/arc/context.hpp"
+#include "arc/detail/coro_promise_base.hpp"
 #include "arc/util/algorithms.hpp"
 #include "arc/util/check.hpp"
 
 #include <atomic>
 #include <coroutine>
+#include <memory>
+#include <optional>
 #include <span>
+#include <stop_token>
+#include <type_traits>
 #include <vector>
 
 namespace arc
@@ -15,6 +21,11 @@ namespace arc
 	struct all;
 }
 
+/**
+ * Awaits every future of a span. The results are read from the futures once all of them are
+ * ready, so the callbacks only count down a shared state. That state outlives the awaitable
+ * because an awaiter that is cancelled is resumed before all results are ready.
+ */
 template <typename T>
 struct arc::all
 {
@@ -22,20 +33,15 @@ public:
 	all() = delete;
 
 	all(arc::context & ctx, std::span<arc::future<T>> futures)
-		: ctx{ ctx }
-		, futures{ futures }
-		, results{ futures.size() }
+		: futures{ futures }
+		, state{ std::make_shared<State>(ctx, futures.size() + 1) }
 	{
-		for (size_t i = 0; i < futures.size(); i++)
+		for (arc::future<T> & future : futures)
 		{
-			if (futures[i])
-				futures[i].async_wait_and_then([this, i](arc::result<T> r) {
-					results[i] = std::move(r);
-					arc_CHECK_Assert(results[i]);
-					complete_one();
-				});
+			if (future)
+				future.async_wait_and_then([state = state] { state->complete_one(); });
 			else
-				complete_one();
+				state->complete_one();
 		}
 	}
 
@@ -43,40 +49,94 @@ public:
 	bool await_ready() const noexcept { return false; }
 
 	/** C++ awaitable API */
-	void await_suspend(std::coroutine_handle<> awaiter_)
+	template <typename Promise>
+	void await_suspend(std::coroutine_handle<Promise> awaiter)
 	{
-		awaiter = awaiter_;
-		complete_one();
+		state->awaiter = awaiter;
+
+		if constexpr (std::is_base_of_v<arc::detail::coro_promise_base, Promise>)
+		{
+			if (awaiter.promise().cancellable())
+			{
+				/** *this may be destroyed by the awaiter as soon as it has been resumed. */
+				std::shared_ptr<State> keepAlive = state;
+				stopCallback.emplace(awaiter.promise().stop_token(), abort{ keepAlive.get() });
+				keepAlive->arm();
+				keepAlive->complete_one();
+				return;
+			}
+		}
+
+		state->complete_one();
 	}
 
 	/** C++ awaitable API */
 	std::vector<arc::result<T>> await_resume()
 	{
-		arc_CHECK_Precondition(ready());
+		if (state->cancelled)
+			throw arc::cancelled{};
+
+		std::vector<arc::result<T>> results;
+		results.reserve(futures.size());
 
-		return std::move(results);
+		/** Copies, the futures of the caller stay untouched. */
+		for (const arc::future<T> & future : futures)
+			results.emplace_back(arc::future<T>{ future }.try_wait());
+
+		return results;
 	}
 
 private:
-	bool ready() const
+	struct State
 	{
-		return doneCount.load(std::memory_order::acquire) == results.size() + 1;
-	}
+		State(arc::context & ctx, size_t count)
+			: ctx{ ctx }
+			, remainingCount{ count }
+		{}
 
-	void complete_one()
-	{
-		size_t currentDoneCount = doneCount.fetch_add(1, std::memory_order::acq_rel) + 1;
+		void complete_one()
+		{
+			if (remainingCount.fetch_sub(1, std::memory_order::acq_rel) == 1)
+				resume(false);
+		}
 
-		if (currentDoneCount != results.size() + 1)
-			return;
+		/**
+		 * Called by the stop callback and once the callback has been registered. A callback that
+		 * runs during its registration must not resume the awaiter, so only the second call does.
+		 */
+		void arm()
+		{
+			if (armed.exchange(true, std::memory_order::acq_rel))
+				resume(true);
+		}
 
-		ctx.schedule_on_worker_thread(awaiter);
-	}
+		/** Only the first call resumes the awaiter. */
+		void resume(bool cancel)
+		{
+			if (resumed.exchange(true, std::memory_order::acq_rel))
+				return;
+
+			cancelled = cancel;
+			ctx.schedule_on_worker_thread(awaiter);
+		}
+
+		arc::context & ctx;
+		std::atomic_size_t remainingCount;
+		std::atomic_bool armed = false;
+		std::atomic_bool resumed = false;
+		bool cancelled = false;
+		std::coroutine_handle<> awaiter;
+	};
+
+	struct abort
+	{
+		void operator()() const { state->arm(); }
+
+		State * state = nullptr;
+	};
 
 private:
-	arc::context & ctx;
 	std::span<arc::future<T>> futures;
-	std::vector<arc::result<T>> results;
-	std::atomic_size_t doneCount = 0;
-	std::coroutine_handle<> awaiter;
+	std::shared_ptr<State> state;
+	std::optional<std::stop_callback<abort>> stopCallback;
 };
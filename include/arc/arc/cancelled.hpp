@@ -0,0 +1,19 @@
+#pragma once
+
+#include <exception>
+
+namespace arc
+{
+	struct cancelled;
+}
+
+/**
+ * Thrown by co_await inside of a computation that has been cancelled because its result is no
+ * longer referenced, see arc::options::cancelUnreferenced. The computation may catch it to clean
+ * up, whatever it returns afterwards is discarded.
+ */
+struct arc::cancelled : std::exception
+{
+public:
+	const char * what() const noexcept override { return "arc::cancelled"; }
+};
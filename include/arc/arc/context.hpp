@@ -5,6 +5,7 @@
 #include "arc/arc/key_of.hpp"
 #include "arc/arc/options.hpp"
 #include "arc/arc/promise_proxy.hpp"
+#include "arc/arc/timer.hpp"
 #include "arc/detail/globals.hpp"
 #include "arc/detail/scheduler.hpp"
 #include "arc/detail/store.hpp"
@@ -46,7 +47,8 @@ public:
 	void schedule_on_worker_thread(arc::function<void()> && task, arc::detail::zone_info zone);
 	auto schedule_on_worker_thread_after(arc::time_point timePoint);
 	void schedule_on_worker_thread_after(std::coroutine_handle<> handle, arc::time_point timePoint);
-	void schedule_on_worker_thread_after(
+	/** The task can be cancelled through the returned arc::timer until it is started. */
+	arc::timer schedule_on_worker_thread_after(
 		arc::function<void()> && task, arc::time_point timePoint, arc::detail::zone_info zone);
 
 	auto schedule_on_main_thread();
@@ -54,7 +56,8 @@ public:
 	void schedule_on_main_thread(arc::function<void()> && task, arc::detail::zone_info zone);
 	auto schedule_on_main_thread_after(arc::time_point timePoint);
 	void schedule_on_main_thread_after(std::coroutine_handle<> handle, arc::time_point timePoint);
-	void schedule_on_main_thread_after(
+	/** The task can be cancelled through the returned arc::timer until it is started. */
+	arc::timer schedule_on_main_thread_after(
 		arc::function<void()> && task, arc::time_point timePoint, arc::detail::zone_info zone);
 
 	/**
@@ -70,6 +73,53 @@ public:
 	void set_caching_policy_global(arc::result<T> global);
 	/** @} */
 
+	/**
+	 * \defgroup Set Caching Policy LRU Keeps the result alive after its last reference has been
+	 * released until it is evicted in favor of more recently released results of this policy. The
+	 * budget is configured by arc::options::lruMaxEntryCount and arc::options::lruMaxBytes, the
+	 * size of a result is estimated by arc::util::memory_usage. The policy applies either to every
+	 * result of a function or to a single result.
+	 * @{
+	 */
+	template <typename F>
+	void set_caching_policy_lru(F * f);
+	template <typename T>
+	void set_caching_policy_lru(arc::future<T> future);
+	template <typename T>
+	void set_caching_policy_lru(arc::result<T> result);
+	/** @} */
+
+	/**
+	 * \defgroup Set Caching Policy TTL Keeps the result alive for timeToLive after its last
+	 * reference has been released, a request within that time reuses the result. Takes precedence
+	 * over the LRU caching policy. The policy applies either to every result of a function or to a
+	 * single result.
+	 * @{
+	 */
+	template <typename F>
+	void set_caching_policy_ttl(F * f, arc::duration timeToLive);
+	template <typename T>
+	void set_caching_policy_ttl(arc::future<T> future, arc::duration timeToLive);
+	template <typename T>
+	void set_caching_policy_ttl(arc::result<T> result, arc::duration timeToLive);
+	/** @} */
+
+	/**
+	 * Destroys the results of f on a background thread instead of the worker that released their
+	 * last reference, see arc::options::deferredDestructionBytes. The results are destroyed in
+	 * batches, all of them before the destruction of arc::context completes.
+	 */
+	template <typename F>
+	void set_destruction_policy_deferred(F * f);
+
+	/**
+	 * Stores the results of f, whose only key must be an integral or an enum, in a dense array
+	 * indexed by the key instead of hashing it. Keys outside of [0, keyCount) are still stored in
+	 * a hash table. Must be called before f is requested for the first time.
+	 */
+	template <typename F>
+	void set_storage_policy_dense(F * f, size_t keyCount);
+
 	const arc::options & options() const;
 
 	template <typename F>
@@ -83,7 +133,7 @@ public:
 
 	template <typename F>
 	arc::future<arc::result_of_t<F>> operator[](
-		F * f, arc::key_of_t<F, 0> key0
+		F * f, const arc::key_of_t<F, 0> & key0
 #if arc_WITH_SOURCE_LOCATION
 		,
 		const std::source_location & sourceLocation = std::source_location::current()
@@ -92,7 +142,7 @@ public:
 
 	template <typename F>
 	arc::future<arc::result_of_t<F>> operator[](
-		F * f, arc::key_of_t<F, 0> key0, arc::key_of_t<F, 1> key1
+		F * f, const arc::key_of_t<F, 0> & key0, const arc::key_of_t<F, 1> & key1
 #if arc_WITH_SOURCE_LOCATION
 		,
 		const std::source_location & sourceLocation = std::source_location::current()
@@ -101,7 +151,8 @@ public:
 
 	template <typename F>
 	arc::future<arc::result_of_t<F>> operator[](
-		F * f, arc::key_of_t<F, 0> key0, arc::key_of_t<F, 1> key1, arc::key_of_t<F, 2> key2
+		F * f, const arc::key_of_t<F, 0> & key0, const arc::key_of_t<F, 1> & key1,
+		const arc::key_of_t<F, 2> & key2
 #if arc_WITH_SOURCE_LOCATION
 		,
 		const std::source_location & sourceLocation = std::source_location::current()
@@ -110,8 +161,8 @@ public:
 
 	template <typename F>
 	arc::future<arc::result_of_t<F>> operator[](
-		F * f, arc::key_of_t<F, 0> key0, arc::key_of_t<F, 1> key1, arc::key_of_t<F, 2> key2,
-		arc::key_of_t<F, 3> key3
+		F * f, const arc::key_of_t<F, 0> & key0, const arc::key_of_t<F, 1> & key1,
+		const arc::key_of_t<F, 2> & key2, const arc::key_of_t<F, 3> & key3
 #if arc_WITH_SOURCE_LOCATION
 		,
 		const std::source_location & sourceLocation = std::source_location::current()
@@ -120,8 +171,9 @@ public:
 
 	template <typename F>
 	arc::future<arc::result_of_t<F>> operator[](
-		F * f, arc::key_of_t<F, 0> key0, arc::key_of_t<F, 1> key1, arc::key_of_t<F, 2> key2,
-		arc::key_of_t<F, 3> key3, arc::key_of_t<F, 4> key4
+		F * f, const arc::key_of_t<F, 0> & key0, const arc::key_of_t<F, 1> & key1,
+		const arc::key_of_t<F, 2> & key2, const arc::key_of_t<F, 3> & key3,
+		const arc::key_of_t<F, 4> & key4
 #if arc_WITH_SOURCE_LOCATION
 		,
 		const std::source_location & sourceLocation = std::source_location::current()
@@ -138,6 +190,10 @@ private:
 	friend struct arc::detail::key_impl;
 
 	friend arc::detail::control_block;
+	friend arc::detail::coro_promise_base;
+	friend arc::detail::release_queue;
+	friend arc::detail::store;
+	friend arc::timer;
 
 	template <typename T>
 	friend struct future;
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+namespace arc
+{
+	struct frame_counters;
+
+	/**
+	 * Thread-safe: Yes.
+	 *
+	 * The counters of all threads since the start of the program. The counters of a thread that is
+	 * still running may lag behind by the allocations it is doing concurrently.
+	 */
+	frame_counters get_frame_counters();
+}
+
+/**
+ * Counts the allocations of the coroutine frames of arc::coro and arc::task, see
+ * arc::detail::frame_pool. The hit rate of the pool is cacheHits / allocations.
+ */
+struct arc::frame_counters
+{
+	/** Frames allocated through the pool. */
+	size_t allocations = 0;
+	/** Allocations served by a frame that has been freed before. */
+	size_t cacheHits = 0;
+	/** Allocations that fell back to operator new, including frames that are too large to pool. */
+	size_t heapAllocations = 0;
+	/** Batches of freed frames that a thread took from the shared pool. */
+	size_t batchesTaken = 0;
+	/** Batches of freed frames that a thread returned to the shared pool. */
+	size_t batchesReturned = 0;
+};
@@ -94,7 +94,8 @@ public:
 	/**
 	 * Suspends the caller until the result is available, then reschedules the caller on a worker
 	 * thread. Returns result on resumption. Resumed immediately with default constructed result if
-	 * *this is default constructed.
+	 * *this is default constructed. Throws arc::cancelled if the awaiting computation has been
+	 * cancelled, see arc::options::cancelUnreferenced.
 	 */
 	auto operator co_await();
 
@@ -105,6 +106,8 @@ private:
 
 	struct impl;
 
+	struct awaitable;
+
 	friend arc::context;
 
 	template <typename U>
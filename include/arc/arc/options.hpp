@@ -1,6 +1,9 @@
 #pragma once
 
+#include "arc/util/util.hpp"
+
 #include <array>
+#include <chrono>
 #include <span>
 #include <thread>
 #include <vector>
@@ -16,6 +19,48 @@ public:
 	size_t workerThreadCount = 0;
 	std::thread::id mainThreadId;
 	std::vector<const char *> args;
+	/**
+	 * Number of independently locked shards of the table of a function in the result store,
+	 * rounded up to a power of two. The count applies per function: every function with keys
+	 * allocates a table of this many shards on first use, each a lock and a bucket array.
+	 */
+	size_t storeShardCount = 8;
+	/** Budget of the results retained by the LRU caching policy. */
+	size_t lruMaxEntryCount = 1024;
+	size_t lruMaxBytes = size_t(256) << 20;
+	/**
+	 * Results of at least this many bytes, estimated by arc::util::memory_usage, are destroyed on
+	 * a background thread instead of the worker that released their last reference. Zero only
+	 * defers the results of functions set by arc::context::set_destruction_policy_deferred().
+	 */
+	size_t deferredDestructionBytes = 0;
+	/**
+	 * The store entries, large keys and continuations of the context are allocated from an arena
+	 * of the context, in chunks of this many bytes that are only freed with the context. Zero
+	 * allocates them one by one from the global heap.
+	 */
+	size_t arenaChunkBytes = size_t(1) << 20;
+	/** Whether the chunks of the arena are backed by transparent huge pages, Linux only. */
+	bool arenaHugePages = false;
+	/**
+	 * Cancels a computation once its result is no longer referenced by anything but the
+	 * computation itself. Its pending co_await are aborted with arc::cancelled, which in turn
+	 * releases the results that only the computation referenced.
+	 */
+	bool cancelUnreferenced = false;
+	/**
+	 * Every worker thread keeps its own deque of tasks and idle workers steal from the others
+	 * instead of all workers sharing a single locked pool.
+	 */
+	bool workStealing = false;
+	/**
+	 * How long a worker that ran out of tasks keeps looking for new ones before it sleeps. Only
+	 * sleeping workers are woken up when a task is scheduled, the wake up is a system call.
+	 * Spinning trades processor time of idle workers for latency, so it is off by default.
+	 */
+	arc::duration idleSpinDuration = arc::duration::zero();
+	/** Whether a spinning worker yields its time slice between the looks instead of pausing. */
+	bool idleSpinYield = false;
 
 	static options two_threads()
 	{
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "arc/arc/context.hpp"
+#include "arc/detail/frame_pool.hpp"
 #include "arc/detail/name_store.hpp"
 #include "arc/util/check.hpp"
 #include "arc/util/non_copyable_non_movable.hpp"
@@ -149,6 +150,14 @@ public:
 
 	final_awaitable final_suspend() const noexcept { return {}; }
 
+	/** Allocates the coroutine frame from the arc::detail::frame_pool. */
+	static void * operator new(size_t size) { return arc::detail::frame_pool::allocate(size); }
+
+	static void operator delete(void * frame, size_t size) noexcept
+	{
+		arc::detail::frame_pool::deallocate(frame, size);
+	}
+
 #if arc_TRACE_INSTRUMENTATION_ENABLE
 	template <typename U>
 	struct awaitable_wrapper
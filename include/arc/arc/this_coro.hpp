@@ -0,0 +1,51 @@
+#pragma once
+
+#include "arc/detail/coro_promise_base.hpp"
+
+#include <coroutine>
+#include <stop_token>
+#include <type_traits>
+
+namespace arc::this_coro
+{
+	struct stop_token_awaitable;
+
+	/**
+	 * Usage: std::stop_token stopToken = co_await arc::this_coro::stop_token();
+	 *
+	 * Returns the stop token of the current run of the arc::coro. It is stopped once the result is
+	 * no longer referenced by anything but the computation itself or when the arc::context shuts
+	 * down. A computation that gives up should throw arc::cancelled, the result of a run that ends
+	 * with an exception after it has been stopped is discarded unless the context shuts down.
+	 *
+	 * The token is created by the first call of a run and stored in the promise, checking it does
+	 * not allocate. It does not abort co_await, see arc::options::cancelUnreferenced for that.
+	 */
+	inline stop_token_awaitable stop_token();
+}
+
+struct arc::this_coro::stop_token_awaitable
+{
+public:
+	/** C++ awaitable API */
+	bool await_ready() const noexcept { return false; }
+
+	/** C++ awaitable API */
+	template <typename Promise>
+	bool await_suspend(std::coroutine_handle<Promise> awaiter)
+	{
+		static_assert(std::is_base_of_v<arc::detail::coro_promise_base, Promise>,
+					  "Only arc::coro has a stop token.");
+
+		token = awaiter.promise().acquire_stop_token();
+		return false;
+	}
+
+	/** C++ awaitable API */
+	std::stop_token await_resume() noexcept { return std::move(token); }
+
+private:
+	std::stop_token token;
+};
+
+inline arc::this_coro::stop_token_awaitable arc::this_coro::stop_token() { return {}; }
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "arc/detail/timer_heap.hpp"
+
+namespace arc
+{
+	struct context;
+	struct timer;
+}
+
+/**
+ * Refers to a task that has been scheduled with arc::context::schedule_on_worker_thread_after or
+ * arc::context::schedule_on_main_thread_after. Must not be used after its arc::context has been
+ * destroyed.
+ */
+struct arc::timer
+{
+public:
+	/** Refers to no task. */
+	timer() = default;
+
+	/**
+	 * Thread-safe: Yes.
+	 *
+	 * Removes the task from the scheduler if it has not been started yet, the task is destroyed
+	 * without running in that case.
+	 *
+	 * \return Whether the task has been removed.
+	 */
+	bool cancel();
+
+	explicit operator bool() const { return ctx; }
+
+private:
+	friend arc::context;
+
+	timer(arc::context & ctx, const arc::detail::timer_id & id, bool mainThread)
+		: ctx{ &ctx }
+		, id{ id }
+		, mainThread{ mainThread }
+	{}
+
+private:
+	arc::context * ctx = nullptr;
+	arc::detail::timer_id id;
+	bool mainThread = false;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "arc/util/non_copyable_non_movable.hpp"
+
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+namespace arc::detail
+{
+	struct arena;
+}
+
+/**
+ * The memory resource of the bookkeeping of an arc::context: its store entries, large keys and
+ * allocated continuations. Blocks are rounded up to a size class and carved from slabs, which are
+ * in turn carved from large chunks, so entries that are created together end up close together.
+ * The chunks are only freed with the arena.
+ *
+ * Freed blocks are kept in free lists for reuse. The free lists and slabs are split into stripes
+ * that are picked by the calling thread, threads rarely contend for the same lock.
+ *
+ * Blocks that are too large or too strictly aligned for a size class are left to operator new.
+ */
+struct arc::detail::arena final : std::pmr::memory_resource
+{
+public:
+	arc_NON_COPYABLE_NON_MOVABLE(arena);
+
+	/**
+	 * \param chunkBytes Zero leaves every allocation to operator new.
+	 * \param hugePages Backs the chunks with transparent huge pages, only supported on Linux.
+	 */
+	arena(size_t chunkBytes, bool hugePages);
+
+	/** Every block must have been deallocated before. */
+	~arena() override;
+
+private:
+	void * do_allocate(size_t bytes, size_t alignment) override;
+
+	void do_deallocate(void * block, size_t bytes, size_t alignment) override;
+
+	bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override
+	{
+		return this == &other;
+	}
+
+	/** \return The size class of the block or class_count if it is not pooled. */
+	static size_t size_class(size_t bytes, size_t alignment);
+
+	/** Locks chunkMutex. */
+	std::byte * allocate_slab();
+
+private:
+	/** Size class i holds blocks of min_block_size << i bytes. */
+	static constexpr size_t min_block_size = 64;
+	static constexpr size_t class_count = 7;
+	static constexpr size_t slab_size = size_t(16) << 10;
+	static constexpr size_t stripe_count = 8;
+
+	struct free_block
+	{
+		free_block * next = nullptr;
+	};
+
+	struct alignas(64) Stripe
+	{
+		std::mutex mtx;
+		/** Guarded by mtx. */
+		std::array<free_block *, class_count> freeBlocks{};
+		/** Guarded by mtx. The unused rest of the current slab of each size class. */
+		std::array<std::byte *, class_count> slabBegin{};
+		std::array<std::byte *, class_count> slabEnd{};
+	};
+
+	const size_t chunkBytes;
+	const size_t chunkAlignment;
+	const bool hugePages;
+
+	std::array<Stripe, stripe_count> stripes;
+
+	std::mutex chunkMutex;
+	/** Guarded by chunkMutex. */
+	std::vector<std::byte *> chunks;
+	/** Guarded by chunkMutex. The unused rest of the last chunk. */
+	std::byte * chunkBegin = nullptr;
+	std::byte * chunkEnd = nullptr;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "arc/detail/scheduler.hpp"
+#include "arc/util/check.hpp"
+#include "arc/util/non_copyable_non_movable.hpp"
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <memory_resource>
+
+namespace arc::detail
+{
+	struct continuation;
+}
+
+/**
+ * A node of the intrusive stack of continuations of a control_block. The stack is walked once,
+ * when the result is published or the entry is removed, and every node that has not been claimed
+ * otherwise is scheduled.
+ */
+struct arc::detail::continuation
+{
+public:
+	arc_NON_COPYABLE_NON_MOVABLE(continuation);
+
+	enum class ownership : uint8_t
+	{
+		/** Lives in the awaitable of a suspended coroutine, which stays alive until scheduled. */
+		awaiter,
+		/** Allocated by the adder and destroyed by whoever walks the stack. */
+		stack,
+		/**
+		 * Allocated by an awaiter that may take its continuation back, see try_claim(). Destroyed
+		 * by the last of the awaitable, the walker and await_suspend() to call release().
+		 */
+		shared,
+	};
+
+	/** \param coroutine The awaiter if task only resumes it, nullptr otherwise. */
+	continuation(arc::detail::scheduler::task && task, ownership owner,
+				 std::coroutine_handle<> coroutine = nullptr)
+		: task{ std::move(task) }
+		, coroutine{ coroutine }
+		, owner{ owner }
+	{}
+
+	/** Allocates a node that is not owned by an awaiter from resource, see destroy(). */
+	static continuation * make(std::pmr::memory_resource & resource,
+							   arc::detail::scheduler::task && task, ownership owner,
+							   std::coroutine_handle<> coroutine = nullptr)
+	{
+		arc_CHECK_Precondition(owner != ownership::awaiter);
+		std::pmr::polymorphic_allocator<> allocator{ &resource };
+		continuation * node = allocator.new_object<continuation>(std::move(task), owner, coroutine);
+		node->resource = &resource;
+		return node;
+	}
+
+	/** Destroys a node allocated by make(). */
+	void destroy() noexcept
+	{
+		arc_CHECK_Precondition(resource);
+		std::pmr::polymorphic_allocator<>{ resource }.delete_object(this);
+	}
+
+	/**
+	 * Thread-safe: Yes. Only if shared.
+	 *
+	 * \return Whether the caller is the first to claim the continuation, only it may resume the
+	 *         awaiter.
+	 */
+	bool try_claim() noexcept
+	{
+		arc_CHECK_Precondition(owner == ownership::shared);
+		return !claimed.exchange(true, std::memory_order::acq_rel);
+	}
+
+	/**
+	 * Thread-safe: Yes. Only if shared.
+	 *
+	 * The stop callback of an awaiter claims the node before its await_suspend() may have added
+	 * it. Only the second of the two to call this resumes the awaiter, so it is not resumed while
+	 * await_suspend() still uses the result.
+	 */
+	bool try_hand_off() noexcept { return handoff.exchange(true, std::memory_order::acq_rel); }
+
+	/** Thread-safe: Yes. Only if shared. */
+	void release() noexcept
+	{
+		arc_CHECK_Precondition(owner == ownership::shared);
+		if (references.fetch_sub(1, std::memory_order::acq_rel) == 1)
+			destroy();
+	}
+
+	arc::detail::scheduler::task task;
+	/** Lets the thread that publishes the result resume the awaiter itself instead of task. */
+	const std::coroutine_handle<> coroutine;
+	continuation * next = nullptr;
+	const ownership owner;
+
+private:
+	/** Only set by make(). */
+	std::pmr::memory_resource * resource = nullptr;
+	std::atomic_bool claimed{ false };
+	std::atomic_bool handoff{ false };
+	std::atomic_uint8_t references{ 3 };
+};
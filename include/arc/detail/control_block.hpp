@@ -1,6 +1,7 @@
 #pragma once
 
 #include "arc/arc/future.hpp"
+#include "arc/detail/continuation.hpp"
 #include "arc/detail/coro_promise_base.hpp"
 #include "arc/detail/handle.hpp"
 #include "arc/detail/result_store.hpp"
@@ -12,8 +13,9 @@
 #include "arc/util/util.hpp"
 
 #include <atomic>
-#include <optional>
-#include <vector>
+#include <memory_resource>
+#include <mutex>
+#include <stop_token>
 
 #if arc_TRACE_INSTRUMENTATION_ENABLE
 	#include <source_location>
@@ -25,6 +27,8 @@ namespace arc::detail
 	 * NOTE: This class uses the scary raw new+delete.
 	 */
 	struct control_block;
+
+	struct lru_cache;
 }
 
 struct arc::detail::control_block
@@ -44,41 +48,115 @@ private:
 
 	friend arc::detail::store;
 	friend arc::detail::handle;
+	friend arc::detail::lru_cache;
+	friend arc::context;
 	friend arc::detail::coro_promise_base;
 
 	template <typename F>
 	friend struct arc::detail::key_impl;
 
 	void add_reference() noexcept;
+	/** Only increments a non-zero reference count. */
+	bool try_add_reference() noexcept;
 	void remove_reference(arc::detail::handle && coroHandle);
 
-	bool is_done() const { return !waiters.read_only()->has_value(); }
+	/**
+	 * Thread-safe: Yes. A single acquire load, the head of the continuations is the completion
+	 * state of the result. Once true the result may be read for as long as a reference is held.
+	 */
+	bool is_done() const
+	{
+		return continuations.load(std::memory_order::acquire) == done_sentinel();
+	}
+
+	/**
+	 * Thread-safe: Yes. Lock-free.
+	 *
+	 * \returns true if the continuation will be scheduled. False means that the window for
+	 *          signaling continuations has passed and that the continuation should be handled by
+	 *          the caller of this function instead, it has not been added in that case.
+	 */
+	bool try_add_continuation(arc::detail::continuation & node);
+
+	/**
+	 * Like the above but allocates the node from resource, the continuation is left untouched on
+	 * false.
+	 */
+	bool try_add_continuation(arc::function<void()> && continuation, arc::detail::zone_info zone,
+							  std::pmr::memory_resource & resource);
+
+	/**
+	 * Thread-safe: Yes.
+	 *
+	 * Takes every continuation, the stack is left done or empty. Once the result is published
+	 * nothing can be added anymore while the stack is done.
+	 */
+	arc::detail::continuation * take_continuations(bool done);
 
 	/**
-	 * \returns true if the continuation was scheduled. False means that the window for signaling
-	 *          continuations has passed and that the continuation should be handled by the caller
-	 *          of this function instead.
+	 * Starts a run of the computation that can be stopped, returns the token of that run. The run
+	 * is stopped right away if stopAll is set or if only the handle of the computation is left.
 	 */
-	bool try_add_continuation(arc::function<void()> && continuation, arc::detail::zone_info zone);
+	std::stop_token renew_stop_source(const std::atomic_bool & stopAll);
 
-	struct Waiters
+	/** The stop source of the current run if it has one and has not published its result. */
+	std::stop_source stop_source_of_run();
+
+	/**
+	 * Drops a reference if the count is two and stops the current run if that leaves only the
+	 * handle of the computation itself.
+	 *
+	 * \returns false if the count was not two, nothing has been changed in that case.
+	 */
+	bool try_remove_reference_and_cancel();
+
+	/** The value of continuations once the result has been published. */
+	arc::detail::continuation * done_sentinel() const
 	{
-		struct Continuation
-		{
-			arc::function<void()> function;
-			arc::detail::zone_info zone;
-		};
-		std::vector<Continuation> continuations;
-	};
+		return reinterpret_cast<arc::detail::continuation *>(
+			const_cast<std::atomic<arc::detail::continuation *> *>(&continuations));
+	}
 
 private:
 	std::atomic_size_t referenceCount{ 0 };
+	/** Whether this entry is retained by the LRU caching policy, regardless of its function. */
+	std::atomic_bool lruPolicy{ false };
+	/** The recency of the entry while it is retained by the arc::detail::lru_cache, else zero. */
+	std::atomic_uint64_t lruStamp{ 0 };
+	/** Whether the lru_cache retains the entry but has not charged its result yet. */
+	std::atomic_bool lruUncharged{ false };
+	/** Guarded by the lock of the lru_cache. The bytes charged for the retained result. */
+	size_t lruBytes = 0;
+	/** The TTL caching policy of this entry, the longer of it and its function's applies. */
+	std::atomic<arc::duration> ttlPolicy{ arc::duration::zero() };
+	/**
+	 * Whether the current run of the computation has a stop source, created up front if
+	 * arc::options::cancelUnreferenced is set or else by the first arc::this_coro::stop_token()
+	 * of the run. Either way the run is stopped once only its own handle is left, only with
+	 * cancelUnreferenced are its pending co_await aborted as well, see
+	 * coro_promise_base::cancellable().
+	 */
+	std::atomic_bool hasStopSource{ false };
 
-	arc::util::shared_guard<std::optional<Waiters>> waiters{ std::in_place };
-#if arc_TRACE_INSTRUMENTATION_ENABLE
 	/**
-	 * HACK: this guarded by dataHandle lock
+	 * Guards stopSource and releasing. The entry is not removed while it is held, even once the
+	 * reference count has dropped to zero.
+	 */
+	std::mutex runMutex;
+	/** Replaced on each run of the computation. */
+	std::stop_source stopSource{ std::nostopstate };
+	/**
+	 * Whether a release has brought the count to zero and has not yet decided whether the entry
+	 * is removed or revived.
 	 */
-	std::vector<std::source_location> requestLocations;
+	bool releasing = false;
+	/**
+	 * Intrusive stack of the continuations that await the result, done_sentinel() once the
+	 * result has been published.
+	 */
+	std::atomic<arc::detail::continuation *> continuations{ nullptr };
+#if arc_TRACE_INSTRUMENTATION_ENABLE
+	/** Cache hits do not hold a store lock, hence the separate guard. */
+	arc::util::shared_guard<std::vector<std::source_location>> requestLocations;
 #endif
 };
@@ -136,7 +136,7 @@ public:
 		arc_CHECK_Precondition(
 			!base.published_early_ && base.self_handle_->second.result.holds_value() && value &&
 			value == base.self_handle_->second.result.template get_value_or_rethrow_exception<T>());
-		base.publish_result();
+		base.publish_result(false);
 		base.published_early_ = true;
 		return false;
 	}
@@ -1,10 +1,12 @@
 #pragma once
 
+#include "arc/detail/frame_pool.hpp"
 #include "arc/detail/handle.hpp"
 #include "arc/util/non_copyable_non_movable.hpp"
 #include "arc/util/tracing.hpp"
 
 #include <coroutine>
+#include <stop_token>
 
 namespace arc
 {
@@ -37,21 +39,70 @@ public:
 		self_handle_ = std::move(handle);
 	}
 
+	/** The stop token of this run if it has been created, see arc::this_coro::stop_token(). */
+	const std::stop_token & stop_token() const noexcept { return stop_token_; }
+
+	/** Returns the stop token of this run, creates it on first use. */
+	const std::stop_token & acquire_stop_token();
+
+	/** Whether a stop aborts the co_await of this run, see arc::options::cancelUnreferenced. */
+	bool cancellable() const noexcept { return cancellable_; }
+
+	void set_stop_token(std::stop_token && stopToken, bool cancellable) noexcept
+	{
+		stop_token_ = std::move(stopToken);
+		cancellable_ = cancellable;
+	}
+
 	/** C++ promise API */
 	std::suspend_always initial_suspend() const noexcept { return {}; }
 
+	/**
+	 * Destroys the coroutine and transfers to the awaiter that publish_result() has chosen to
+	 * resume on this thread, if any.
+	 */
+	struct final_awaiter
+	{
+		bool await_ready() const noexcept { return false; }
+
+		template <typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> self) const noexcept
+		{
+			return self.promise().finish(self);
+		}
+
+		void await_resume() const noexcept {}
+	};
+
 	/** C++ promise API */
-	std::suspend_never final_suspend() const noexcept { return {}; }
+	final_awaiter final_suspend() const noexcept { return {}; }
 
 	/** C++ promise API */
 	void unhandled_exception() noexcept;
 
+	/** C++ promise API, allocates the coroutine frame from the arc::detail::frame_pool. */
+	static void * operator new(size_t size) { return arc::detail::frame_pool::allocate(size); }
+
+	/** C++ promise API */
+	static void operator delete(void * frame, size_t size) noexcept
+	{
+		arc::detail::frame_pool::deallocate(frame, size);
+	}
+
 protected:
 	coro_promise_base() = default;
 
 	~coro_promise_base();
 
-	void publish_result() noexcept;
+	/**
+	 * \param final Whether the coroutine returns right after. Only then one awaiter may be kept
+	 *              back to be resumed by final_suspend(), a result that is published early is
+	 *              still being computed.
+	 */
+	void publish_result(bool final = true) noexcept;
+
+	/** Destroys the coroutine self, returns what its final_suspend() transfers to. */
+	std::coroutine_handle<> finish(std::coroutine_handle<> self) noexcept;
 
 	template <typename T>
 	friend struct arc::publish;
@@ -60,5 +111,15 @@ protected:
 	/** For keeping itself alive while computing the result. */
 	arc::detail::handle self_handle_;
 
+	std::stop_token stop_token_;
+
 	bool published_early_ = false;
+
+	bool cancellable_ = false;
+
+	/** Whether the run ended with an exception after it has been stopped. */
+	bool cancelled_ = false;
+
+	/** The awaiter that final_suspend() resumes, see publish_result(). */
+	std::coroutine_handle<> inline_continuation_ = nullptr;
 };
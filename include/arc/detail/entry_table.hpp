@@ -0,0 +1,157 @@
+#pragma once
+
+#include "arc/detail/control_block.hpp"
+#include "arc/detail/epoch_domain.hpp"
+#include "arc/detail/key.hpp"
+#include "arc/util/check.hpp"
+#include "arc/util/non_copyable_non_movable.hpp"
+#include "arc/util/tracing.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace arc::detail
+{
+	struct entry_table;
+}
+
+/**
+ * Hash table of store entries whose lookups do not lock.
+ *
+ * Writers (emplace(), erase()) must be serialized by the owner. Readers call find() inside of a
+ * read_section and may run concurrently with a writer. A reader may miss an entry that is being
+ * moved to a larger bucket array, so a miss must be confirmed by the owner under its write lock.
+ * A hit is always genuine.
+ *
+ * Erased nodes and replaced bucket arrays are retired rather than freed and are only destroyed
+ * once every read section that may still reach them has ended, see arc::detail::epoch_domain.
+ * Entries never move, a store_entry pointer stays valid until the entry has been erased.
+ */
+struct arc::detail::entry_table : arc_TRACE_CONTAINER_BASE
+{
+public:
+	arc_NON_COPYABLE_NON_MOVABLE(entry_table);
+
+	entry_table();
+
+	~entry_table();
+
+	/** Thread-safe: Only before first use. Allocates the nodes, must outlive this table. */
+	void set_memory_resource(std::pmr::memory_resource & memoryResource)
+	{
+		arc_CHECK_Precondition(!count && retiredNodes.empty());
+		resource = &memoryResource;
+	}
+
+	/** Protects the nodes and bucket arrays of every entry_table. */
+	using read_section = arc::detail::epoch_domain::read_section;
+
+	/**
+	 * Thread-safe: Inside of a read_section or while holding the owner's write lock.
+	 *
+	 * \param equals Called with the const store_entry & of every entry that has a matching hash.
+	 */
+	template <typename Equals>
+	arc::detail::store_entry * find(uint64_t hash, Equals && equals) const
+	{
+		const bucket_array * array = buckets.load(std::memory_order::seq_cst);
+
+		for (node * it = array->heads[hash & array->mask].load(std::memory_order::seq_cst); it;
+			 it = it->next.load(std::memory_order::seq_cst))
+		{
+			if (it->hash == hash && equals(std::as_const(it->entry)))
+				return &it->entry;
+		}
+
+		return nullptr;
+	}
+
+	/** Thread-safe: Only while holding the owner's write lock. */
+	template <typename... KeyArgs>
+	arc::detail::store_entry & emplace(uint64_t hash, KeyArgs &&... keyArgs)
+	{
+		if (count + 1 > bucket_count())
+			grow();
+
+		node * n = std::pmr::polymorphic_allocator<>{ resource }.new_object<node>(
+			hash, std::forward<KeyArgs>(keyArgs)...);
+
+		bucket_array * array = buckets.load(std::memory_order::relaxed);
+		std::atomic<node *> & head = array->heads[hash & array->mask];
+		n->next.store(head.load(std::memory_order::relaxed), std::memory_order::relaxed);
+		head.store(n, std::memory_order::seq_cst);
+
+		count++;
+		Plot(int64_t(count));
+
+		return n->entry;
+	}
+
+	/** Thread-safe: Only while holding the owner's write lock. */
+	void erase(const arc::detail::store_entry & entry, uint64_t hash);
+
+	/** Thread-safe: Only while holding the owner's write lock. */
+	size_t size() const { return count; }
+
+	/** Thread-safe: Only while holding the owner's write lock. */
+	template <typename Function>
+	void for_each(Function && function)
+	{
+		const bucket_array * array = buckets.load(std::memory_order::relaxed);
+
+		for (size_t i = 0; i <= array->mask; i++)
+			for (node * it = array->heads[i].load(std::memory_order::relaxed); it;
+				 it = it->next.load(std::memory_order::relaxed))
+				function(it->entry);
+	}
+
+private:
+	struct node
+	{
+		template <typename... KeyArgs>
+		node(uint64_t hash, KeyArgs &&... keyArgs)
+			: hash{ hash }
+			, entry{ std::piecewise_construct,
+					 std::forward_as_tuple(std::forward<KeyArgs>(keyArgs)...),
+					 std::forward_as_tuple() }
+		{}
+
+		std::atomic<node *> next{ nullptr };
+		const uint64_t hash;
+		arc::detail::store_entry entry;
+	};
+
+	struct bucket_array
+	{
+		explicit bucket_array(size_t size)
+			: mask{ size - 1 }
+			, heads{ std::make_unique<std::atomic<node *>[]>(size) }
+		{}
+
+		const size_t mask;
+		std::unique_ptr<std::atomic<node *>[]> heads;
+	};
+
+	size_t bucket_count() const { return buckets.load(std::memory_order::relaxed)->mask + 1; }
+
+	void grow();
+
+	/** Destroys the retired nodes and arrays that no read section can reach anymore. */
+	void try_reclaim();
+
+	void delete_node(node * n) { std::pmr::polymorphic_allocator<>{ resource }.delete_object(n); }
+
+private:
+	std::atomic<bucket_array *> buckets;
+	size_t count = 0;
+	std::pmr::memory_resource * resource = std::pmr::new_delete_resource();
+
+	/** In the order of their epochs, see arc::detail::epoch_domain::advance(). */
+	std::vector<std::pair<uint64_t, node *>> retiredNodes;
+	std::vector<std::pair<uint64_t, std::unique_ptr<bucket_array>>> retiredArrays;
+};
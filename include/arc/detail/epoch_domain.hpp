@@ -0,0 +1,97 @@
+#pragma once
+
+#include "arc/util/non_copyable_non_movable.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace arc::detail
+{
+	struct epoch_domain;
+}
+
+/**
+ * Epoch-based reclamation of the memory that lock-free readers may still reach.
+ *
+ * A reader announces the current epoch in a record of its own thread for the duration of a
+ * read_section. A writer unlinks memory, advances the epoch and retires the memory with the new
+ * epoch. It may free it once oldest_reader_epoch() is at least that epoch, as every reader that
+ * could still reach it announced an older one.
+ *
+ * Readers only write the cache line of their own record, and a long or sustained stream of reads
+ * only holds back what was retired while the oldest of them was reading.
+ */
+struct arc::detail::epoch_domain
+{
+public:
+	/** Announced by threads that are not inside of a read_section. */
+	static constexpr uint64_t quiescent = std::numeric_limits<uint64_t>::max();
+
+	/** The reclamation state of a thread. Records are reused by later threads, never freed. */
+	struct alignas(64) record
+	{
+		/** The epoch the thread read in, written by the thread and read by writers. */
+		std::atomic_uint64_t epoch{ quiescent };
+		/** Only used by the thread, read sections may be nested. */
+		size_t depth = 0;
+		std::atomic_bool inUse{ false };
+		/** Immutable once the record has been published. */
+		record * next = nullptr;
+	};
+
+	/** Keeps memory retired while it is alive from being freed. May be nested. */
+	class read_section
+	{
+	public:
+		arc_NON_COPYABLE_NON_MOVABLE(read_section);
+
+		read_section() noexcept
+			: threadRecord{ localRecord ? *localRecord : acquire_record() }
+		{
+			/**
+			 * The acquire load synchronizes with the advance() that retired anything this
+			 * section may not reach, the seq_cst store orders the announcement before the loads
+			 * of the reader and against the loads of oldest_reader_epoch().
+			 */
+			if (threadRecord.depth++ == 0)
+				threadRecord.epoch.store(
+					globalEpoch.load(std::memory_order::acquire), std::memory_order::seq_cst);
+		}
+
+		~read_section()
+		{
+			if (--threadRecord.depth == 0)
+				threadRecord.epoch.store(quiescent, std::memory_order::release);
+		}
+
+	private:
+		record & threadRecord;
+	};
+
+	/**
+	 * Thread-safe: Yes. Called after unlinking memory.
+	 *
+	 * \return The epoch to retire the unlinked memory with.
+	 */
+	static uint64_t advance() { return globalEpoch.fetch_add(1, std::memory_order::seq_cst) + 1; }
+
+	/**
+	 * Thread-safe: Yes.
+	 *
+	 * \return The oldest epoch announced by a thread inside of a read_section, quiescent if there
+	 *         is none. Memory retired with an epoch of at most this one may be freed.
+	 */
+	static uint64_t oldest_reader_epoch();
+
+private:
+	/** Claims a free record or publishes a new one, it is released when the thread exits. */
+	static record & acquire_record() noexcept;
+
+private:
+	static inline std::atomic_uint64_t globalEpoch{ 1 };
+	/** The published records, linked by record::next. */
+	static inline std::atomic<record *> records{ nullptr };
+	static inline thread_local constinit record * localRecord = nullptr;
+};
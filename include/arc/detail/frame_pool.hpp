@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+namespace arc::detail
+{
+	struct frame_pool;
+}
+
+/**
+ * Allocates the coroutine frames of arc::coro and arc::task, see their promise_type::operator new.
+ *
+ * Frames are rounded up to a size class and freed frames are kept in free lists of the thread that
+ * freed them, which serve the next allocations of that thread without locking. A thread that frees
+ * more frames than it allocates, for example because the frames have been allocated by another
+ * thread, returns the excess to a shared pool in batches. A thread whose free list has run dry
+ * takes a whole batch from there. The frames that a thread frees once its cache is gone are
+ * collected in the shared pool until they fill a batch. Frames that are too large are left to
+ * operator new.
+ *
+ * The allocations are counted, see arc::get_frame_counters().
+ */
+struct arc::detail::frame_pool
+{
+public:
+	/** Thread-safe: Yes. */
+	static void * allocate(size_t size);
+
+	/** Thread-safe: Yes. \param size Must be the size that frame has been allocated with. */
+	static void deallocate(void * frame, size_t size) noexcept;
+};
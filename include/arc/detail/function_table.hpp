@@ -0,0 +1,149 @@
+#pragma once
+
+#include "arc/detail/entry_table.hpp"
+#include "arc/detail/key.hpp"
+#include "arc/util/non_copyable_non_movable.hpp"
+#include "arc/util/util.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#if arc_TRACE_INSTRUMENTATION_ENABLE
+	#include <string_view>
+#endif
+
+namespace arc::detail
+{
+	struct function_table;
+
+	/**
+	 * Thread-safe: Yes. Does not lock unless function is new.
+	 *
+	 * \return A process-wide unique index of function, assigned on first use and dense.
+	 */
+	size_t function_index(arc::detail::function_untyped_t function);
+}
+
+/**
+ * The entries of a single memoized function. All of its keys are key_impl<F> for the same F and
+ * function pointer, so lookups compare the argument tuples directly.
+ *
+ * The entries are split into independently locked shards that are picked by the hash of the
+ * arguments.
+ */
+struct arc::detail::function_table
+{
+public:
+	arc_NON_COPYABLE_NON_MOVABLE(function_table);
+
+	struct Shard
+	{
+		/** Serializes the writers of table, readers do not lock. */
+		std::mutex writeMutex;
+		arc::detail::entry_table table;
+	};
+
+	/**
+	 * \param shardCount Must be a power of two.
+	 * \param resource Allocates the entries and large keys of the table, must outlive it.
+	 */
+	function_table(arc::detail::function_untyped_t function, size_t shardCount,
+				   std::pmr::memory_resource & resource);
+
+	~function_table();
+
+	Shard & shard_of(uint64_t hash)
+	{
+		/**
+		 * The low bits of the hash select the bucket inside the shard, so the shard is taken from
+		 * the high bits of the hash multiplied by 2^64 / phi, which depend on all of its bits.
+		 */
+		return shards[((hash * 0x9E3779B97F4A7C15) >> shardShift) & shardMask];
+	}
+
+#if arc_TRACE_INSTRUMENTATION_ENABLE
+	/** Must be called before first use of the table. */
+	void configure(std::string_view name);
+#endif
+
+	/** Thread-safe: Only while no other thread uses this table. */
+	size_t size();
+
+	std::pmr::memory_resource & memory_resource() const { return resource; }
+
+	/** Thread-safe: Yes. Calls function with every entry while holding the lock of its shard. */
+	template <typename Function>
+	void for_each_entry(Function && function)
+	{
+		for (size_t i = 0; i <= shardMask; i++)
+		{
+			std::lock_guard lk{ shards[i].writeMutex };
+			shards[i].table.for_each(function);
+		}
+	}
+
+	/**
+	 * Publishes the entries with keys in [0, keyCount) in a dense array of slots, the hash of every
+	 * key in the range becomes its index.
+	 *
+	 * Thread-safe: Yes, but only before first use of this table, an entry that was found through
+	 * the hash table before would not be found through its slot.
+	 */
+	void set_dense_key_count(size_t keyCount);
+
+	/**
+	 * Thread-safe: Yes.
+	 *
+	 * \return The slot of index or nullptr if it is outside of the dense range.
+	 */
+	std::atomic<arc::detail::store_entry *> * dense_slot(size_t index)
+	{
+		if (index >= denseKeyCount.load(std::memory_order::acquire))
+			return nullptr;
+
+		std::atomic<arc::detail::store_entry *> * slots =
+			denseChunks[index / dense_chunk_size].load(std::memory_order::acquire);
+
+		if (!slots)
+			slots = allocate_dense_chunk(index / dense_chunk_size);
+
+		return &slots[index % dense_chunk_size];
+	}
+
+	/** The function of this table, cast back to F * to call or compare it. */
+	const arc::detail::function_untyped_t function;
+
+	/** Whether the entries are retained by the LRU caching policy. */
+	std::atomic_bool lruPolicy{ false };
+	/** How long the entries are retained by the TTL caching policy, zero if they are not. */
+	std::atomic<arc::duration> ttlPolicy{ arc::duration::zero() };
+	/** Whether the results are destroyed by the arc::detail::result_reclaimer. */
+	std::atomic_bool deferredDestruction{ false };
+
+	/**
+	 * The only entry of a function without keys.
+	 *
+	 * Like the dense slots it is written under the lock of the shard that owns the entry and read
+	 * inside of a read_section.
+	 */
+	std::atomic<arc::detail::store_entry *> singleEntry{ nullptr };
+
+private:
+	static constexpr size_t dense_chunk_size = 256;
+
+	std::atomic<arc::detail::store_entry *> * allocate_dense_chunk(size_t chunk);
+
+private:
+	std::pmr::memory_resource & resource;
+	std::unique_ptr<Shard[]> shards;
+	const size_t shardMask;
+	/** 64 minus the number of shard bits, at most 63 to keep the shift defined. */
+	const int shardShift;
+
+	/** Released after denseChunks has been allocated. */
+	std::atomic_size_t denseKeyCount{ 0 };
+	/** The chunks of dense slots are allocated on first use. */
+	std::unique_ptr<std::atomic<std::atomic<arc::detail::store_entry *> *>[]> denseChunks;
+};
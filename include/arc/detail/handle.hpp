@@ -26,6 +26,12 @@ public:
 private:
 	explicit handle(arc::detail::store_entry * storeEntry);
 
+	/**
+	 * Returns an empty handle instead of acquiring a reference if the reference count of the
+	 * entry is zero. Reviving an entry is left to arc::detail::store under its lock.
+	 */
+	static handle try_acquire(arc::detail::store_entry * storeEntry) noexcept;
+
 	void acquire();
 	void release();
 	void abandon();
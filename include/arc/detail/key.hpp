@@ -3,17 +3,21 @@
 #include "arc/arc/key_of.hpp"
 #include "arc/util/algorithms.hpp"
 #include "arc/util/check.hpp"
+#include "arc/util/non_copyable_non_movable.hpp"
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
-#include <functional>
-#include <memory>
+#include <memory_resource>
+#include <new>
 #include <stdexcept>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 
 namespace arc
 {
-	using hash_algorithm = util::FNV_1a_64;
+	using hash_algorithm = util::wyhash_64;
 }
 
 namespace arc::detail
@@ -24,69 +28,77 @@ namespace arc::detail
 
 	using function_untyped_t = void (*)();
 
+	struct function_table;
+
 	struct key_impl_base;
 
 	template <typename F>
 	struct key_impl;
 
+	template <typename F>
+	struct key_view;
+
 	struct key;
+
+	template <typename Arguments>
+	uint64_t key_hash(const Arguments & arguments);
+
+	/** Whether F has a single integral or enum key that can index a dense array. */
+	template <typename F>
+	consteval bool has_dense_key();
 }
 
 struct arc::detail::key_impl_base
 {
 public:
-	virtual bool operator==(const key_impl_base &) const = 0;
 	virtual function_untyped_t get_function_untyped() const = 0;
 	virtual const void * get_arguments_untyped() const = 0;
 	virtual size_t hash_value() const = 0;
 	virtual void call(arc::detail::store_entry & storeEntry) const = 0;
 	virtual arc::context & get_ctx() const = 0;
+	/** Destroys a key_impl that has been allocated from resource. */
+	virtual void destroy(std::pmr::memory_resource & resource) = 0;
 	virtual ~key_impl_base() = default;
 };
 
+/**
+ * Only the arguments are hashed, the function is implied by the function_table of the entry.
+ *
+ * NOTE: Hash value may be different on each application start because the address of the
+ *       arc::context is part of the arguments.
+ */
+template <typename Arguments>
+uint64_t arc::detail::key_hash(const Arguments & arguments)
+{
+	arc::hash_algorithm hash;
+	hash_append(hash, arguments);
+	return hash.result();
+}
+
 template <typename F>
-struct arc::detail::key_impl final : arc::detail::key_impl_base
+consteval bool arc::detail::has_dense_key()
 {
-public:
-	template <typename... Args>
-	key_impl(F * function, Args &&... arguments)
-		: function_{ function }
-		, arguments_{ std::forward<Args>(arguments)... }
+	if constexpr (arc::key_count_of_v<F> != 1)
 	{
-		{
-			arc::hash_algorithm hash;
-
-			/**
-			 * NOTE: This requires a compiler-specific extension: function-pointer
-			 *       (with unspecified value due to the cast) to uintptr_t cast.
-			 * NOTE: Hash value for a type may be different on each application
-			 *       start because of address space layout randomization.
-			 */
-			hash_append(hash, reinterpret_cast<uintptr_t>(get_function_untyped()));
-
-			hash_append(hash, arguments_);
-
-			hash_value_ = hash.result();
-		}
+		return false;
 	}
-
-	bool operator==(const key_impl_base & other) const override
+	else
 	{
-		/**
-		 * NOTE: This requires a compiler-specific behavior: comparison of function
-		 *       pointers whose value is unspecified due to the cast.
-		 */
-		if (get_function_untyped() != other.get_function_untyped())
-		{
-			return false;
-		}
-		else
-		{
-			const auto & otherArguments =
-				*static_cast<const args_tuple_t<F> *>(other.get_arguments_untyped());
-			return arguments_ == otherArguments;
-		}
+		using key_type = std::tuple_element_t<1, args_tuple_t<F>>;
+		return std::is_integral_v<key_type> || std::is_enum_v<key_type>;
 	}
+}
+
+template <typename F>
+struct arc::detail::key_impl final : arc::detail::key_impl_base
+{
+public:
+	key_impl(F * function, const arc::util::add_tuple_const_reference_t<args_tuple_t<F>> & arguments,
+			 uint64_t hashValue)
+		: function_{ function }
+		, arguments_{ arguments }
+		, hash_value_{ hashValue }
+	{}
 
 	function_untyped_t get_function_untyped() const override
 	{
@@ -95,54 +107,142 @@ public:
 
 	const void * get_arguments_untyped() const override { return &arguments_; }
 
+	const args_tuple_t<F> & get_arguments() const { return arguments_; }
+
 	size_t hash_value() const override { return hash_value_; }
 
 	void call(arc::detail::store_entry & storeEntry) const override;
 
 	arc::context & get_ctx() const override { return std::get<0>(arguments_); }
 
+	void destroy(std::pmr::memory_resource & resource) override
+	{
+		std::pmr::polymorphic_allocator<>{ &resource }.delete_object(this);
+	}
+
 private:
 	F * function_ = nullptr;
 	args_tuple_t<F> arguments_;
 	uint64_t hash_value_ = 0;
 };
 
+/**
+ * Borrows the arguments of a lookup so that the store can hash and compare them against its keys
+ * without copying them. The owning key_impl is only created if the store has no matching entry.
+ */
+template <typename F>
+struct arc::detail::key_view
+{
+public:
+	template <typename... Args>
+	key_view(F * function, arc::context & ctx, const Args &... arguments)
+		: function{ function }
+		, arguments{ ctx, arguments... }
+	{}
+
+	/** Thread-safe: key must be a key of the function_table of function. */
+	bool operator==(const arc::detail::key & key) const;
+
+	uint64_t hash_value() const { return key_hash(arguments); }
+
+	/** Only if has_dense_key<F>(): The key as an index, negative keys wrap around. */
+	size_t dense_index() const
+	{
+		const auto & value = std::get<1>(arguments);
+
+		if constexpr (std::is_enum_v<std::remove_cvref_t<decltype(value)>>)
+			return size_t(std::to_underlying(value));
+		else
+			return size_t(value);
+	}
+
+	F * const function;
+	const arc::util::add_tuple_const_reference_t<args_tuple_t<F>> arguments;
+};
+
+/**
+ * The key_impl of common argument tuples (a few integers or a short string) is stored inline, only
+ * larger ones are allocated from the memory resource of the function_table. Because of that a key
+ * can not be moved, it is constructed in place in its store_entry.
+ */
 struct arc::detail::key
 {
 public:
+	arc_NON_COPYABLE_NON_MOVABLE(key);
+
 	key() = delete;
 
-	template <typename F, typename... Args>
-	key(F * f, arc::context & ctx, Args &&... args)
-		: impl_{ std::make_unique<key_impl<F>>(f, ctx, std::forward<Args>(args)...) }
-	{}
+	/** \param slot Where the entry of this key is published, if any. */
+	template <typename F>
+	key(const arc::detail::key_view<F> & view, uint64_t hash, arc::detail::function_table & table,
+		std::atomic<arc::detail::store_entry *> * slot)
+		: table_{ table }
+		, slot_{ slot }
+	{
+		if constexpr (sizeof(key_impl<F>) <= inline_capacity &&
+					  alignof(key_impl<F>) <= alignof(std::max_align_t))
+			impl_ = ::new (buffer_) key_impl<F>{ view.function, view.arguments, hash };
+		else
+			impl_ = std::pmr::polymorphic_allocator<>{ &memory_resource() }.new_object<key_impl<F>>(
+				view.function, view.arguments, hash);
+	}
+
+	~key();
 
 	arc::context & get_ctx() const { return impl_->get_ctx(); }
 
 	void call(arc::detail::store_entry & storeEntry) const { impl_->call(storeEntry); }
 
-	template <typename T, size_t I, typename F>
-	const T & get_key(F * f) const
+	/** The table that owns the entry of this key. */
+	arc::detail::function_table & get_table() const { return table_; }
+
+	/** The slot of the function_table that publishes the entry of this key, if any. */
+	std::atomic<arc::detail::store_entry *> * get_slot() const { return slot_; }
+
+	/** \return nullptr if this key does not belong to f. */
+	template <typename F>
+	const args_tuple_t<F> * get_arguments(F * f) const
 	{
 		if (reinterpret_cast<function_untyped_t>(f) != impl_->get_function_untyped())
-			throw std::logic_error("Incorrect function pointer passed to get_key().");
+			return nullptr;
 
-		const auto & args =
-			*reinterpret_cast<const args_tuple_t<F> *>(impl_->get_arguments_untyped());
+		return static_cast<const args_tuple_t<F> *>(impl_->get_arguments_untyped());
+	}
 
-		return std::get<I + 1>(args);
+	/** Without checks and without virtual calls, the key must be a key of a function of type F. */
+	template <typename F>
+	const key_impl<F> & get_impl() const
+	{
+		return *static_cast<const key_impl<F> *>(impl_);
 	}
 
-	friend bool operator==(const key & lhs, const key & rhs) { return *lhs.impl_ == *rhs.impl_; }
+	template <typename T, size_t I, typename F>
+	const T & get_key(F * f) const
+	{
+		const args_tuple_t<F> * args = get_arguments(f);
+		if (!args)
+			throw std::logic_error("Incorrect function pointer passed to get_key().");
+
+		return std::get<I + 1>(*args);
+	}
 
 	size_t hash_value() const { return impl_->hash_value(); }
 
 private:
-	std::unique_ptr<key_impl_base> impl_;
+	/** The memory resource of the table, the key_impl is allocated from it if it is not inline. */
+	std::pmr::memory_resource & memory_resource() const;
+
+private:
+	static constexpr size_t inline_capacity = 64;
+
+	alignas(std::max_align_t) std::byte buffer_[inline_capacity];
+	key_impl_base * impl_ = nullptr;
+	arc::detail::function_table & table_;
+	std::atomic<arc::detail::store_entry *> * const slot_;
 };
 
-template <>
-struct std::hash<arc::detail::key>
+template <typename F>
+bool arc::detail::key_view<F>::operator==(const arc::detail::key & key) const
 {
-	size_t operator()(const arc::detail::key & value) const { return value.hash_value(); }
-};
+	return key.get_impl<F>().get_arguments() == arguments;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "arc/detail/control_block.hpp"
+#include "arc/detail/handle.hpp"
+#include "arc/util/guard.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace arc::detail
+{
+	struct store;
+	struct lru_cache;
+}
+
+/**
+ * Holds a reference to the entries of the LRU caching policy after their last reference has been
+ * released elsewhere. The least recently used entries are released by a worker task once the
+ * entry count or the byte budget is exceeded.
+ *
+ * An entry is used when it is retained and when it is requested again while it is retained. A
+ * request only stamps the control_block, the entries are kept in a heap by the stamp they were
+ * pushed with and an entry whose stamp has moved on is pushed again instead of being evicted. If
+ * it is still referenced when it is evicted it will be retained anew once that reference is
+ * released.
+ *
+ * A result that is still being computed when it is retained is charged once it is published.
+ */
+struct arc::detail::lru_cache
+{
+public:
+	/** \param store Releases the evicted entries, must outlive the scheduler of the entries. */
+	lru_cache(arc::detail::store & store, size_t maxEntryCount, size_t maxBytes);
+
+	/**
+	 * Thread-safe: Yes.
+	 *
+	 * \return False if the cache has been closed, storeEntry is left untouched in that case.
+	 */
+	bool retain(arc::detail::handle & storeEntry);
+
+	/** Thread-safe: Yes. Lock-free. Marks the entry of controlBlock as used if it is retained. */
+	void touch(arc::detail::control_block & controlBlock) const
+	{
+		if (controlBlock.lruStamp.load(std::memory_order::relaxed))
+			controlBlock.lruStamp.store(
+				2 * retainCount.load(std::memory_order::relaxed) + 1, std::memory_order::relaxed);
+	}
+
+	/**
+	 * Thread-safe: Yes. Charges the result of controlBlock if it has been retained before it was
+	 * published, does nothing otherwise.
+	 */
+	void charge(arc::detail::control_block & controlBlock);
+
+	/** Thread-safe: Yes. Releases every entry and retains no entries afterwards. */
+	void close();
+
+private:
+	void evict();
+
+	struct State;
+
+	/** Must be called while holding the lock of state. Charges the result if it is uncharged. */
+	static void charge_locked(State & s, arc::detail::control_block & controlBlock);
+
+	/** Must be called while holding the lock of state. */
+	bool over_budget(const State & s) const
+	{
+		return s.entries.size() > maxEntryCount || s.bytes > maxBytes;
+	}
+
+private:
+	struct Entry
+	{
+		arc::detail::handle storeEntry;
+		/** The stamp of the control_block when the entry was pushed. */
+		uint64_t stamp = 0;
+	};
+
+	struct State
+	{
+		/** Min-heap by stamp, see older(). */
+		std::vector<Entry> entries;
+		size_t bytes = 0;
+		bool evictionScheduled = false;
+		bool closed = false;
+	};
+
+	/** The order of the heap, the entry with the oldest stamp is evicted first. */
+	static bool older(const Entry & lhs, const Entry & rhs) { return lhs.stamp > rhs.stamp; }
+
+	arc::detail::store & store;
+	const size_t maxEntryCount;
+	const size_t maxBytes;
+	/**
+	 * Entries that are retained are stamped with 2 * retainCount, entries that are used while
+	 * they are retained with 2 * retainCount + 1, so that they count as newer than the last one.
+	 */
+	std::atomic_uint64_t retainCount{ 0 };
+	arc::util::shared_guard<State> state;
+};
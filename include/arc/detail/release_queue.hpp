@@ -0,0 +1,48 @@
+#pragma once
+
+#include "arc/detail/handle.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace arc::detail
+{
+	struct store;
+	struct release_queue;
+}
+
+/**
+ * Collects the handles whose reference count would drop to zero until a task of high priority
+ * releases them all at once, see arc::detail::store::release_references(). Every worker thread has
+ * a lane of its own, all other threads share the last one. At most one task per lane is pending.
+ */
+struct arc::detail::release_queue
+{
+public:
+	/** \param store Releases the handles, must outlive the scheduler of the handles. */
+	release_queue(arc::detail::store & store, size_t workerThreadCount);
+
+	/** Thread-safe: Yes. */
+	void push(arc::detail::handle && storeEntry);
+
+private:
+	void drain(size_t lane);
+
+private:
+	struct alignas(64) Lane
+	{
+		std::mutex mtx;
+		/** Guarded by mtx. */
+		std::vector<arc::detail::handle> handles;
+		/** Guarded by mtx. */
+		bool drainScheduled = false;
+		/** Only used by the pending task of the lane. */
+		std::vector<arc::detail::handle> draining;
+	};
+
+	arc::detail::store & store;
+	const size_t laneCount;
+	std::unique_ptr<Lane[]> lanes;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "arc/detail/result_store.hpp"
+#include "arc/util/non_copyable_non_movable.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace arc::detail
+{
+	struct result_reclaimer;
+}
+
+/**
+ * Destroys the results of deferred destruction on a thread of its own, so that large or slow
+ * destructors do not hold up the worker that released the last reference. The results that piled
+ * up while the previous batch was destroyed are destroyed together as the next batch.
+ *
+ * The thread is started on first use. A destructor may still release references to other
+ * entries, which keeps the scheduler alive until the results that hold them are destroyed.
+ */
+struct arc::detail::result_reclaimer
+{
+public:
+	arc_NON_COPYABLE_NON_MOVABLE(result_reclaimer);
+
+	result_reclaimer() = default;
+	/** Destroys every pending result before it returns. */
+	~result_reclaimer();
+
+	/** Thread-safe: Yes. */
+	void reclaim(arc::detail::result_store && result);
+
+private:
+	void run(std::stop_token stopToken);
+
+private:
+	std::mutex mtx;
+	std::condition_variable_any cv;
+	/** Guarded by mtx. */
+	std::vector<arc::detail::result_store> pending;
+	/** Started under mtx, declared last to be joined before the other members are destroyed. */
+	std::jthread thread;
+};
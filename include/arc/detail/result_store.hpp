@@ -1,8 +1,16 @@
 #pragma once
 
+#include "arc/util/algorithms.hpp"
 #include "arc/util/check.hpp"
 #include "arc/util/debug.hpp"
 
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
 namespace arc::detail
 {
 	struct result_store;
@@ -11,14 +19,64 @@ namespace arc::detail
 struct arc::detail::result_store
 {
 public:
+	/** Values of at most this many bytes are stored in place, see stored_inline. */
+	static constexpr size_t inline_capacity = 48;
+
+	/**
+	 * Small values that can be moved without throwing are constructed in the buffer of the
+	 * result_store instead of on the heap, they are only moved by extract().
+	 */
+	template <typename T>
+	static constexpr bool stored_inline = sizeof(T) <= inline_capacity &&
+		alignof(T) <= alignof(std::max_align_t) &&
+		std::is_nothrow_move_constructible_v<std::remove_const_t<T>>;
+
+	result_store() = default;
+	result_store(result_store && other) noexcept
+		: result{ std::exchange(other.result, std::monostate{}) }
+		, memoryUsage{ std::exchange(other.memoryUsage, nullptr) }
+	{
+		if (auto * value = std::get_if<inline_type>(&result))
+			value->relocate(other.buffer, buffer);
+	}
+	~result_store()
+	{
+		if (auto * value = std::get_if<inline_type>(&result))
+			value->destroy(buffer);
+	}
+
 	template <typename T, typename... Args>
 	T & emplace_value(Args &&... args)
 	{
 		arc_CHECK_Precondition(holds_nothing());
-		T * value = new T{ std::forward<Args>(args)... };
-		result.emplace<result_type<T>>(static_cast<void_ptr<T>>(value), [](void_ptr<T> value) {
-			delete reinterpret_cast<T *>(value);
-		});
+		T * value = nullptr;
+		if constexpr (stored_inline<T>)
+		{
+			/** Constructed without const, so that extract() may move from it. */
+			using mut_type = std::remove_const_t<T>;
+			value = ::new (static_cast<void *>(buffer)) mut_type{ std::forward<Args>(args)... };
+			result.emplace<inline_type>(
+				[](std::byte * storage) {
+					std::destroy_at(std::launder(reinterpret_cast<mut_type *>(storage)));
+				},
+				[](std::byte * from, std::byte * to) {
+					mut_type * fromValue = std::launder(reinterpret_cast<mut_type *>(from));
+					::new (static_cast<void *>(to)) mut_type{ std::move(*fromValue) };
+					std::destroy_at(fromValue);
+				},
+				&type_tag<mut_type>, std::is_const_v<T>);
+		}
+		else
+		{
+			value = new T{ std::forward<Args>(args)... };
+			result.emplace<result_type<T>>(static_cast<void_ptr<T>>(value), [](void_ptr<T> value) {
+				delete reinterpret_cast<T *>(value);
+			});
+		}
+		memoryUsage = [](const void * value) {
+			using mut_type = std::remove_const_t<T>;
+			return arc::util::memory_usage<mut_type>{}(*static_cast<const T *>(value));
+		};
 		return *value;
 	}
 
@@ -49,6 +107,17 @@ public:
 	template <typename T>
 	T * get_value_or_rethrow_exception() const
 	{
+		if (auto * value = std::get_if<inline_type>(&result))
+		{
+			arc_CHECK_Precondition(value->isConst == std::is_const_v<T>);
+			if constexpr (std::is_void_v<T>)
+				return inline_value();
+			else
+			{
+				arc_CHECK_Precondition(value->type == &type_tag<std::remove_const_t<T>>);
+				return std::launder(static_cast<T *>(inline_value()));
+			}
+		}
 		if (auto * exception = std::get_if<std::exception_ptr>(&result))
 			std::rethrow_exception(*exception);
 		arc_CHECK_Precondition(std::holds_alternative<result_type<T>>(result));
@@ -58,15 +127,42 @@ public:
 	void reset()
 	{
 		arc_CHECK_Precondition(!holds_nothing());
+		if (auto * value = std::get_if<inline_type>(&result))
+			value->destroy(buffer);
 		result.emplace<std::monostate>();
+		memoryUsage = nullptr;
+	}
+
+	/** Moves the result into the returned result_store and leaves nothing behind, like reset(). */
+	result_store extract()
+	{
+		arc_CHECK_Precondition(!holds_nothing());
+		return result_store{ std::move(*this) };
+	}
+
+	/** Only owned values are counted, see arc::util::memory_usage. */
+	size_t memory_usage() const
+	{
+		if (!memoryUsage)
+			return 0;
+		else if (std::holds_alternative<inline_type>(result))
+			return memoryUsage(inline_value());
+		else if (auto * value = std::get_if<mut_result_type>(&result))
+			return memoryUsage(value->get());
+		else
+			return memoryUsage(std::get<const_result_type>(result).get());
 	}
 
 	bool holds_value() const
 	{
-		return std::holds_alternative<mut_result_type>(result) ||
+		return std::holds_alternative<inline_type>(result) ||
+			std::holds_alternative<mut_result_type>(result) ||
 			std::holds_alternative<const_result_type>(result);
 	}
 
+	/** True for values created by emplace_value(), false for references from emplace_ref(). */
+	bool owns_value() const { return memoryUsage != nullptr; }
+
 	bool holds_exception() const { return std::holds_alternative<std::exception_ptr>(result); }
 
 	bool holds_nothing() const { return std::holds_alternative<std::monostate>(result); }
@@ -79,6 +175,31 @@ private:
 	template <typename T>
 	using void_ptr = arc::util::const_matching_void_t<T> *;
 
+	/** Its address identifies the type of a value in buffer. */
+	template <typename T>
+	static constexpr char type_tag = 0;
+
+	/** The type-erased operations on a value in buffer. */
+	struct inline_type
+	{
+		void (*destroy)(std::byte * storage);
+		/** Move constructs the value at to and destroys it at from. */
+		void (*relocate)(std::byte * from, std::byte * to);
+		/** The type_tag of the value without const. */
+		const char * type;
+		/** The value was emplaced as const, it must be read as const like a const_result_type. */
+		bool isConst;
+	};
+
+	/** The value in buffer, mutable like the values of mut_result_type. */
+	void * inline_value() const { return const_cast<std::byte *>(buffer); }
+
 private:
-	std::variant<std::monostate, mut_result_type, const_result_type, std::exception_ptr> result;
+	std::variant<std::monostate, mut_result_type, const_result_type, std::exception_ptr,
+				 inline_type>
+		result;
+	/** Only set for values created by emplace_value(). */
+	size_t (*memoryUsage)(const void *) = nullptr;
+	/** Holds the value if result holds inline_type. */
+	alignas(std::max_align_t) std::byte buffer[inline_capacity];
 };
@@ -1,13 +1,19 @@
 #pragma once
 
 #include "arc/detail/name_store.hpp"
+#include "arc/detail/timer_heap.hpp"
+#include "arc/detail/work_stealing_deque.hpp"
 #include "arc/util/non_copyable_non_movable.hpp"
 #include "arc/util/util.hpp"
 
+#include <atomic>
 #include <condition_variable>
 #include <coroutine>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <optional>
+#include <span>
 #include <stop_token>
 #include <thread>
 #include <utility>
@@ -31,7 +37,18 @@ public:
 		arc::detail::zone_info zone;
 	};
 
-	scheduler(std::thread::id mainThreadId, size_t workerThreadCount);
+	/** How a thread that ran out of work waits for more, see arc::options::idleSpinDuration. */
+	struct idle_policy
+	{
+		/** How long to look for new work before sleeping, zero sleeps right away. */
+		arc::duration spinDuration = arc::duration::zero();
+		/** Yield the time slice between the looks instead of pausing the processor. */
+		bool yield = false;
+	};
+
+	/** \param workStealing Whether the worker threads use the stealing_pool. */
+	scheduler(std::thread::id mainThreadId, size_t workerThreadCount, bool workStealing,
+			  const idle_policy & idle);
 
 	~scheduler();
 
@@ -75,11 +92,39 @@ public:
 
 	void schedule(task && task, bool mainThread, bool highPrio);
 
+	/**
+	 * Thread-safe: Yes.
+	 *
+	 * Moves every task of tasks to the queue under a single lock and wakes at most as many
+	 * sleeping threads as there are tasks.
+	 */
+	void schedule(std::span<task> tasks, bool mainThread);
+
+	/** Thread-safe: Yes. */
+	arc::detail::timer_id schedule_after(task && task, arc::time_point timePoint, bool mainThread);
+
+	/**
+	 * Thread-safe: Yes.
+	 *
+	 * \return Whether the task of id has been removed before it was started.
+	 */
+	bool cancel(const arc::detail::timer_id & id, bool mainThread);
+
+	/**
+	 * Thread-safe: Yes.
+	 *
+	 * \return The index of the calling thread among the worker threads of this scheduler, nothing
+	 *         for any other thread.
+	 */
+	std::optional<size_t> current_worker() const;
+
 	static constexpr bool ArcSchedulerWorkPool_USING_QUEUE = false;
 
 private:
 	void worker(std::stop_token stopToken, std::optional<size_t> workerIndex);
 
+	void stealing_worker(std::stop_token stopToken, std::optional<size_t> workerIndex);
+
 	/** Thread-safe: No. */
 	void start_workers(size_t count);
 
@@ -94,23 +139,72 @@ private:
 		std::mutex mtx;
 #endif
 
-		using timed_task = std::pair<arc::time_point, task>;
-		/**
-		 * Ties are inserted after all the existing elements. Keep that in mind
-		 * if replacing with e.g. std::priority_queue which is not stable.
-		 */
-		arc_TRACE_CONTAINER_VECTOR(timed_task) timers;
+		/** Ties run in the order they were scheduled. */
+		arc::detail::timer_heap<task> timers;
 
 		/** poor man's multi-prio queue */
 		arc_TRACE_CONTAINER_QUEUE(task) highPrioTasks;
 		arc_TRACE_CONTAINER_STACK(task) tasks;
+
+		/** The size of highPrioTasks and tasks, so spinning threads can watch it without mtx. */
+		std::atomic_size_t pendingCount{ 0 };
+		/** The threads waiting on cv, only they need to be notified. Guarded by mtx. */
+		size_t sleeperCount = 0;
+	};
+
+	/**
+	 * Alternative to the work_pool of the worker threads. Every worker owns a deque that it pushes
+	 * its tasks to, idle workers steal from the deques of random other workers. Tasks that are
+	 * scheduled by any other thread go through the injection queue. High priority tasks go to its
+	 * front whoever schedules them, and workers look at it before their own deques while there
+	 * are any. A worker also looks at the injection queue first every so often, so that a worker
+	 * that keeps feeding its deque does not starve the injected tasks.
+	 */
+	struct stealing_pool
+	{
+		explicit stealing_pool(size_t workerCount);
+
+		/** The state of a worker that only the worker itself touches. */
+		struct alignas(64) worker_state
+		{
+			/** The task nodes of the deques that have been taken, for reuse by the next push. */
+			std::vector<std::unique_ptr<task>> freeTasks;
+			size_t popCount = 0;
+		};
+
+		std::unique_ptr<arc::detail::work_stealing_deque<task>[]> deques;
+		std::unique_ptr<worker_state[]> workerStates;
+		const size_t workerCount;
+
+		/** Guards injected, timers and wakeEpoch. */
+		std::mutex mtx;
+		std::condition_variable_any cv;
+
+		std::deque<task> injected;
+		std::atomic_size_t injectedCount{ 0 };
+		/** The high priority tasks at the front of injected. */
+		std::atomic_size_t injectedHighPrioCount{ 0 };
+
+		arc::detail::timer_heap<task> timers;
+		/** The time point of the first timer, arc::time_point::max() if there is none. */
+		std::atomic<arc::time_point> nextTimer{ arc::time_point::max() };
+
+		/**
+		 * A worker that found no work registers as sleeper and scans again before it waits for the
+		 * epoch to change, whoever pushes a task afterwards sees the sleeper and changes the epoch.
+		 */
+		std::atomic_size_t sleeperCount{ 0 };
+		size_t wakeEpoch = 0;
 	};
 
 private:
 	work_pool workerThreadWork;
 	work_pool mainThreadWork;
+	/** Replaces workerThreadWork if set. */
+	std::unique_ptr<stealing_pool> stealing;
 
 	std::vector<std::thread> workers;
 	std::stop_source stopSource;
 	std::thread::id mainThreadId;
+	const idle_policy idle;
 };
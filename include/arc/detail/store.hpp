@@ -1,13 +1,25 @@
 #pragma once
 
+#include "arc/detail/arena.hpp"
 #include "arc/detail/control_block.hpp"
+#include "arc/detail/entry_table.hpp"
+#include "arc/detail/function_table.hpp"
 #include "arc/detail/handle.hpp"
 #include "arc/detail/key.hpp"
+#include "arc/detail/lru_cache.hpp"
+#include "arc/detail/release_queue.hpp"
+#include "arc/detail/result_reclaimer.hpp"
+#include "arc/detail/ttl_cache.hpp"
 #include "arc/util/guard.hpp"
 #include "arc/util/tracing.hpp"
 #include "arc/util/util.hpp"
 
+#include <array>
+#include <atomic>
+#include <mutex>
 #include <queue>
+#include <span>
+#include <stop_token>
 #if arc_WITH_SOURCE_LOCATION
 	#include <source_location>
 #endif
@@ -17,33 +29,258 @@ namespace arc::detail
 	struct store;
 }
 
+/**
+ * Every memoized function has its own function_table that is created on first use. The tables
+ * are found through a lock-free directory indexed by function_index(), every function has a slot
+ * of its own.
+ *
+ * Lookups of existing entries do not lock, only insertions and erasures take the shard lock.
+ * Entries are never relocated, store_entry pointers stay valid until the entry is erased.
+ */
 struct arc::detail::store
 {
 public:
-	store();
+	/**
+	 * \param shardCount Shards of the function_table of each function with keys, rounded up to a
+	 *                   power of two.
+	 * \param workerThreadCount The lanes of the release queue, see arc::detail::release_queue.
+	 * \param deferredDestructionBytes See arc::options::deferredDestructionBytes.
+	 * \param arenaChunkBytes See arc::options::arenaChunkBytes.
+	 * \param arenaHugePages See arc::options::arenaHugePages.
+	 */
+	store(size_t shardCount, size_t lruMaxEntryCount, size_t lruMaxBytes,
+		  size_t workerThreadCount, size_t deferredDestructionBytes, size_t arenaChunkBytes,
+		  bool arenaHugePages);
 	~store();
 
+	/** Only materializes a key from keyView if no entry matches it. */
+	template <typename F>
 	arc::detail::handle retrieve_reference(
-		arc::detail::key && key
+		const arc::detail::key_view<F> & keyView
 #if arc_WITH_SOURCE_LOCATION
 		,
 		const std::source_location & sourceLocation
 #endif
 	);
 
-	void release_reference(arc::detail::handle && coroHandle);
+	/**
+	 * \param retain False if the entry must not be retained by a caching policy, for example
+	 *               because it is being evicted.
+	 */
+	void release_reference(arc::detail::handle && coroHandle, bool retain = true);
+
+	/**
+	 * Like release_reference() for every handle of handles. The entries whose count drops to zero
+	 * are removed or revived under a single acquisition of the lock of each of their shards.
+	 */
+	void release_references(std::span<arc::detail::handle> handles, bool retain = true);
+
+	/**
+	 * Thread-safe: Yes.
+	 *
+	 * Releases the handle soon on a worker thread, together with the handles released around the
+	 * same time.
+	 */
+	void queue_release(arc::detail::handle && coroHandle) { releases.push(std::move(coroHandle)); }
+
+	/**
+	 * Takes the handle of a computation that ended after it has been cancelled. Restarts the
+	 * computation if its result has been requested again meanwhile, removes the entry otherwise.
+	 */
+	void finish_cancelled(arc::detail::handle && coroHandle);
+
+	/** Releases the entries retained by caching policies and retains no entries afterwards. */
+	void stop_retaining();
+
+	/** See arc::detail::control_block::renew_stop_source(). */
+	std::stop_token renew_stop_source(arc::detail::control_block & controlBlock)
+	{
+		return controlBlock.renew_stop_source(stopRequested);
+	}
+
+	/** Stops the runs of all computations, including those that start afterwards. */
+	void request_stop();
+
+	bool stop_requested() const { return stopRequested.load(std::memory_order::acquire); }
 
 	void set_empty_once_callback(arc::function<void()> && emptyOnceCallback);
 
-private:
-	struct Data
+	/** Thread-safe: Yes. See arc::detail::lru_cache::charge(). */
+	void charge_retained(arc::detail::control_block & controlBlock) { lru.charge(controlBlock); }
+
+	/** See arc::context::set_caching_policy_lru(). */
+	template <typename F>
+	void set_lru_policy(F * f)
 	{
-		arc_TRACE_CONTAINER_UNORDERED_MAP(arc::detail::key, arc::detail::control_block) store;
-		std::queue<arc::function<void()>> emptyOnceCallbacks;
-	};
+		table_of(f).lruPolicy.store(true, std::memory_order::relaxed);
+	}
+
+	/** See arc::context::set_caching_policy_ttl(). */
+	template <typename F>
+	void set_ttl_policy(F * f, arc::duration timeToLive)
+	{
+		table_of(f).ttlPolicy.store(timeToLive, std::memory_order::relaxed);
+	}
+
+	/** See arc::context::set_destruction_policy_deferred(). */
+	template <typename F>
+	void set_deferred_destruction(F * f)
+	{
+		table_of(f).deferredDestruction.store(true, std::memory_order::relaxed);
+	}
+
+	/** See arc::context::set_storage_policy_dense(). */
+	template <typename F>
+	void set_dense_key_count(F * f, size_t keyCount)
+	{
+		static_assert(arc::detail::has_dense_key<F>());
+		table_of(f).set_dense_key_count(keyCount);
+	}
+
+private:
+	/** Returns the table of f, creates it on first use. */
+	template <typename F>
+	arc::detail::function_table & table_of(F * f);
+
+	/** Returns the slot of the table of the function with functionIndex. */
+	std::atomic<arc::detail::function_table *> & table_slot(size_t functionIndex);
+
+	arc::detail::function_table & insert_table(
+		std::atomic<arc::detail::function_table *> & slot, arc::detail::function_untyped_t function,
+		size_t tableShardCount);
 
-	static_assert(std::is_same_v<arc::detail::store_entry, decltype(Data{}.store)::value_type>);
+	void run_empty_once_callbacks();
 
 private:
-	arc::util::recursive_guard<Data> data;
+	/** Declared first, it outlives everything that has been allocated from it. */
+	arc::detail::arena arena;
+	/** Chunk i holds the slots of 8 << i functions, chunks are allocated on first use. */
+	std::array<std::atomic<std::atomic<arc::detail::function_table *> *>, 48> tableChunks{};
+	size_t shardCount = 0;
+	/** Sum of the sizes of all tables. */
+	std::atomic_size_t entryCount{ 0 };
+	arc::util::shared_guard<std::queue<arc::function<void()>>> emptyOnceCallbacks;
+	arc::detail::lru_cache lru;
+	arc::detail::ttl_cache ttl;
+	arc::detail::release_queue releases;
+	std::atomic_bool stopRequested{ false };
+	/** See arc::options::deferredDestructionBytes. */
+	size_t deferredDestructionBytes = 0;
+	/** Its pending results are destroyed before the destruction of the store completes. */
+	arc::detail::result_reclaimer reclaimer;
+#if arc_TRACE_INSTRUMENTATION_ENABLE
+	/** Only used to give the tables distinct names. */
+	std::atomic_size_t tableCount{ 0 };
+#endif
 };
+
+template <typename F>
+arc::detail::handle arc::detail::store::retrieve_reference(
+	const arc::detail::key_view<F> & keyView
+#if arc_WITH_SOURCE_LOCATION
+	,
+	const std::source_location & sourceLocation
+#endif
+)
+{
+	arc_TRACE_EVENT_SCOPED(arc_TRACE_CORO);
+
+	arc::detail::function_table & table = table_of(keyView.function);
+
+	/**
+	 * The entry of a function without keys and the entries of dense keys are published in a slot,
+	 * the other entries are found by hashing their arguments.
+	 */
+	std::atomic<arc::detail::store_entry *> * slot = nullptr;
+	uint64_t hash = 0;
+
+	if constexpr (arc::key_count_of_v<F> == 0)
+	{
+		slot = &table.singleEntry;
+	}
+	else if constexpr (arc::detail::has_dense_key<F>())
+	{
+		/** Keys outside of the dense range, negative keys among them, are hashed like any key. */
+		const size_t index = keyView.dense_index();
+		slot = table.dense_slot(index);
+		hash = slot ? index : keyView.hash_value();
+	}
+	else
+	{
+		hash = keyView.hash_value();
+	}
+
+	arc::detail::function_table::Shard & shard = table.shard_of(hash);
+
+	auto find = [&] {
+		if (slot)
+			return slot->load(std::memory_order::seq_cst);
+		else
+			return shard.table.find(
+				hash, [&keyView](const arc::detail::store_entry & entry) {
+					return keyView == entry.first;
+				});
+	};
+
+	arc::detail::handle result;
+
+	/** Cache hits of entries that are still referenced do not lock. */
+	{
+		arc::detail::entry_table::read_section section;
+		if (arc::detail::store_entry * entry = find())
+			result = arc::detail::handle::try_acquire(entry);
+	}
+
+	/** Only entries that are still referenced can be retained by the LRU caching policy. */
+	if (result)
+		lru.touch(result->second);
+
+	if (!result)
+	{
+		bool inserted = false;
+
+		{
+			std::lock_guard lk{ shard.writeMutex };
+
+			arc::detail::store_entry * entry = find();
+			if (!entry)
+			{
+				entry = &shard.table.emplace(hash, keyView, hash, table, slot);
+				inserted = true;
+				entryCount.fetch_add(1, std::memory_order::acq_rel);
+				if (slot)
+					slot->store(entry, std::memory_order::seq_cst);
+			}
+
+			/**
+			 * Acquired under the lock because this may revive an entry whose reference count
+			 * dropped to zero, which release_reference() checks under the same lock.
+			 */
+			result = arc::detail::handle{ entry };
+		}
+
+		if (inserted)
+			result->first.call(*result.storeEntry);
+	}
+
+#if arc_TRACE_INSTRUMENTATION_ENABLE && arc_WITH_SOURCE_LOCATION
+	result->second.requestLocations.read_and_write()->emplace_back(sourceLocation);
+#endif
+
+	return result;
+}
+
+template <typename F>
+arc::detail::function_table & arc::detail::store::table_of(F * f)
+{
+	const auto function = reinterpret_cast<arc::detail::function_untyped_t>(f);
+
+	std::atomic<arc::detail::function_table *> & slot =
+		table_slot(arc::detail::function_index(function));
+
+	if (arc::detail::function_table * table = slot.load(std::memory_order::acquire))
+		return *table;
+
+	/** A function without keys has a single entry, sharding its table would be wasted. */
+	return insert_table(slot, function, arc::key_count_of_v<F> ? shardCount : 1);
+}
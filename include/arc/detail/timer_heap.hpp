@@ -0,0 +1,188 @@
+#pragma once
+
+#include "arc/util/check.hpp"
+#include "arc/util/util.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace arc::detail
+{
+	struct timer_id;
+
+	template <typename T>
+	struct timer_heap;
+}
+
+/** Refers to an element of a timer_heap for as long as the element is in the heap. */
+struct arc::detail::timer_id
+{
+	uint32_t slot = 0;
+	uint64_t sequence = std::numeric_limits<uint64_t>::max();
+};
+
+/**
+ * Binary min-heap of elements that are due at a time point. Inserting, removing the first element
+ * and removing an element by its timer_id take O(log n).
+ *
+ * Elements with the same time point leave the heap in the order they were inserted, every element
+ * is ordered by its time point and then by a sequence number that is increased on every insert.
+ *
+ * Every element owns a slot that tracks its position in the heap. Slots are reused, the sequence
+ * number tells whether a timer_id still refers to the element of its slot.
+ */
+template <typename T>
+struct arc::detail::timer_heap
+{
+public:
+	arc::detail::timer_id push(arc::time_point timePoint, T && element)
+	{
+		uint32_t slot = 0;
+		if (freeSlots.size())
+		{
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else
+		{
+			slot = uint32_t(slots.size());
+			slots.emplace_back();
+		}
+
+		const uint64_t sequence = nextSequence++;
+		slots[slot].sequence = sequence;
+
+		nodes.push_back(Node{ timePoint, sequence, slot, std::move(element) });
+		sift_up(nodes.size() - 1);
+
+		return { slot, sequence };
+	}
+
+	/** Precondition: Not empty. */
+	arc::time_point next_time_point() const
+	{
+		arc_CHECK_Precondition(nodes.size());
+		return nodes.front().timePoint;
+	}
+
+	/** Precondition: Not empty. Removes and returns the first element. */
+	T pop()
+	{
+		arc_CHECK_Precondition(nodes.size());
+		return remove_at(0);
+	}
+
+	/** \return The element of id or nothing if it has left the heap already. */
+	std::optional<T> erase(const arc::detail::timer_id & id)
+	{
+		if (id.slot >= slots.size() || slots[id.slot].sequence != id.sequence)
+			return std::nullopt;
+
+		return remove_at(slots[id.slot].position);
+	}
+
+	size_t size() const { return nodes.size(); }
+
+	bool empty() const { return nodes.empty(); }
+
+private:
+	struct Node
+	{
+		arc::time_point timePoint;
+		uint64_t sequence = 0;
+		uint32_t slot = 0;
+		T element;
+
+		bool operator<(const Node & other) const
+		{
+			return timePoint < other.timePoint ||
+				   (timePoint == other.timePoint && sequence < other.sequence);
+		}
+	};
+
+	struct Slot
+	{
+		size_t position = 0;
+		/** The sequence number of the element in this slot, max() if the slot is free. */
+		uint64_t sequence = std::numeric_limits<uint64_t>::max();
+	};
+
+	T remove_at(size_t index)
+	{
+		Node & node = nodes[index];
+		slots[node.slot].sequence = std::numeric_limits<uint64_t>::max();
+		freeSlots.push_back(node.slot);
+
+		T element = std::move(node.element);
+
+		if (index + 1 < nodes.size())
+		{
+			place(index, std::move(nodes.back()));
+			nodes.pop_back();
+
+			if (index && nodes[index] < nodes[(index - 1) / 2])
+				sift_up(index);
+			else
+				sift_down(index);
+		}
+		else
+		{
+			nodes.pop_back();
+		}
+
+		return element;
+	}
+
+	void place(size_t index, Node && node)
+	{
+		slots[node.slot].position = index;
+		nodes[index] = std::move(node);
+	}
+
+	void sift_up(size_t index)
+	{
+		Node node = std::move(nodes[index]);
+
+		while (index)
+		{
+			const size_t parent = (index - 1) / 2;
+			if (!(node < nodes[parent]))
+				break;
+			place(index, std::move(nodes[parent]));
+			index = parent;
+		}
+
+		place(index, std::move(node));
+	}
+
+	void sift_down(size_t index)
+	{
+		Node node = std::move(nodes[index]);
+		const size_t count = nodes.size();
+
+		while (true)
+		{
+			size_t child = 2 * index + 1;
+			if (child >= count)
+				break;
+			if (child + 1 < count && nodes[child + 1] < nodes[child])
+				child++;
+			if (!(nodes[child] < node))
+				break;
+			place(index, std::move(nodes[child]));
+			index = child;
+		}
+
+		place(index, std::move(node));
+	}
+
+private:
+	std::vector<Node> nodes;
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeSlots;
+	uint64_t nextSequence = 0;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "arc/arc/timer.hpp"
+#include "arc/detail/handle.hpp"
+#include "arc/util/guard.hpp"
+#include "arc/util/util.hpp"
+
+#include <map>
+#include <optional>
+
+namespace arc::detail
+{
+	struct store;
+	struct ttl_cache;
+}
+
+/**
+ * Holds a reference to the entries of the TTL caching policy for a while after their last
+ * reference has been released elsewhere. Expired entries are released by a timer task of the
+ * scheduler, only the timer of the earliest expiry is pending at a time. A timer that is superseded
+ * by an earlier expiry is cancelled.
+ *
+ * An entry that is requested again before it expires keeps its expiry, but if it is still
+ * referenced when it expires it will be retained anew once that reference is released.
+ */
+struct arc::detail::ttl_cache
+{
+public:
+	/** \param store Releases the expired entries, must outlive the scheduler of the entries. */
+	explicit ttl_cache(arc::detail::store & store);
+
+	/**
+	 * Thread-safe: Yes.
+	 *
+	 * \return False if the cache has been closed, storeEntry is left untouched in that case.
+	 */
+	bool retain(arc::detail::handle & storeEntry, arc::time_point expiry);
+
+	/** Thread-safe: Yes. Releases every entry and retains no entries afterwards. */
+	void close();
+
+private:
+	void expire(arc::time_point timerExpiry);
+
+private:
+	struct State
+	{
+		std::multimap<arc::time_point, arc::detail::handle> entries;
+		std::optional<arc::time_point> scheduledExpiry;
+		/** The pending timer of scheduledExpiry. */
+		arc::timer timer;
+		bool closed = false;
+	};
+
+	arc::detail::store & store;
+	arc::util::shared_guard<State> state;
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "arc/util/check.hpp"
+#include "arc/util/non_copyable_non_movable.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace arc::detail
+{
+	template <typename T>
+	struct work_stealing_deque;
+}
+
+/**
+ * Chase-Lev deque of pointers. Its owner pushes and pops at the bottom, any other thread steals
+ * from the top, so the owner works on its most recent tasks while thieves take the oldest ones.
+ *
+ * The ring buffer grows when it is full. A thief may still read from a replaced buffer, so all of
+ * them are kept until the deque is destroyed.
+ *
+ * The deque does not own the elements, it must be empty when it is destroyed.
+ */
+template <typename T>
+struct arc::detail::work_stealing_deque
+{
+public:
+	arc_NON_COPYABLE_NON_MOVABLE(work_stealing_deque);
+
+	/** \param capacity Must be a power of two. */
+	explicit work_stealing_deque(size_t capacity = 256)
+	{
+		arc_CHECK_Precondition(capacity && !(capacity & (capacity - 1)));
+		buffers.push_back(std::make_unique<Buffer>(capacity));
+		buffer.store(buffers.back().get(), std::memory_order::relaxed);
+	}
+
+	~work_stealing_deque() { arc_CHECK_Require(empty()); }
+
+	/** Thread-safe: Only by the owner. */
+	void push(T * element)
+	{
+		const int64_t b = bottom.load(std::memory_order::relaxed);
+		const int64_t t = top.load(std::memory_order::acquire);
+		Buffer * ring = buffer.load(std::memory_order::relaxed);
+
+		if (b - t > int64_t(ring->mask))
+			ring = grow(ring, t, b);
+
+		ring->put(b, element);
+		/** Sequentially consistent so that a following check for sleeping thieves sees it. */
+		bottom.store(b + 1, std::memory_order::seq_cst);
+	}
+
+	/**
+	 * Thread-safe: Only by the owner.
+	 *
+	 * \return The most recently pushed element or nullptr if the deque is empty.
+	 */
+	T * pop()
+	{
+		const int64_t b = bottom.load(std::memory_order::relaxed) - 1;
+		Buffer * ring = buffer.load(std::memory_order::relaxed);
+		bottom.store(b, std::memory_order::seq_cst);
+		int64_t t = top.load(std::memory_order::seq_cst);
+
+		if (t > b)
+		{
+			bottom.store(b + 1, std::memory_order::relaxed);
+			return nullptr;
+		}
+
+		T * element = ring->get(b);
+
+		/** The last element, race the thieves for it. */
+		if (t == b)
+		{
+			if (!top.compare_exchange_strong(
+					t, t + 1, std::memory_order::seq_cst, std::memory_order::relaxed))
+				element = nullptr;
+			bottom.store(b + 1, std::memory_order::relaxed);
+		}
+
+		return element;
+	}
+
+	/**
+	 * Thread-safe: Yes.
+	 *
+	 * \return The oldest element or nullptr if the deque is empty or another thread won the race.
+	 */
+	T * steal()
+	{
+		int64_t t = top.load(std::memory_order::seq_cst);
+		const int64_t b = bottom.load(std::memory_order::seq_cst);
+
+		if (t >= b)
+			return nullptr;
+
+		T * element = buffer.load(std::memory_order::acquire)->get(t);
+
+		if (!top.compare_exchange_strong(
+				t, t + 1, std::memory_order::seq_cst, std::memory_order::relaxed))
+			return nullptr;
+
+		return element;
+	}
+
+	/** Thread-safe: Yes, but the answer may be outdated already. */
+	bool empty() const
+	{
+		return top.load(std::memory_order::seq_cst) >= bottom.load(std::memory_order::seq_cst);
+	}
+
+private:
+	struct Buffer
+	{
+		explicit Buffer(size_t capacity)
+			: mask{ capacity - 1 }
+			, slots{ std::make_unique<std::atomic<T *>[]>(capacity) }
+		{}
+
+		T * get(int64_t index) const
+		{
+			return slots[size_t(index) & mask].load(std::memory_order::relaxed);
+		}
+
+		void put(int64_t index, T * element)
+		{
+			slots[size_t(index) & mask].store(element, std::memory_order::relaxed);
+		}
+
+		const size_t mask;
+		std::unique_ptr<std::atomic<T *>[]> slots;
+	};
+
+	Buffer * grow(Buffer * ring, int64_t t, int64_t b)
+	{
+		buffers.push_back(std::make_unique<Buffer>(2 * (ring->mask + 1)));
+		Buffer * grown = buffers.back().get();
+
+		for (int64_t i = t; i < b; i++)
+			grown->put(i, ring->get(i));
+
+		buffer.store(grown, std::memory_order::release);
+		return grown;
+	}
+
+private:
+	/** Separate cache lines, the owner writes bottom while thieves write top. */
+	alignas(64) std::atomic<int64_t> top{ 0 };
+	alignas(64) std::atomic<int64_t> bottom{ 0 };
+	std::atomic<Buffer *> buffer{ nullptr };
+	/** Only accessed by the owner. */
+	std::vector<std::unique_ptr<Buffer>> buffers;
+};
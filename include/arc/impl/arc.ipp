@@ -1,8 +1,12 @@
 #pragma once
 
+#include "arc/arc/cancelled.hpp"
 #include "arc/detail/name_store.hpp"
 #include "arc/util/tracing.hpp"
 
+#include <optional>
+#include <stop_token>
+
 template <typename F>
 arc::future<arc::result_of_t<F>> arc::context::operator[](
 	F * f
@@ -14,7 +18,7 @@ arc::future<arc::result_of_t<F>> arc::context::operator[](
 {
 	static_assert(arc::key_count_of_v<F> == 0);
 	return arc::future<arc::result_of_t<F>>{ store.retrieve_reference(
-		arc::detail::key{ f, *this }
+		arc::detail::key_view{ f, *this }
 #if arc_WITH_SOURCE_LOCATION
 		,
 		sourceLocation
@@ -24,7 +28,7 @@ arc::future<arc::result_of_t<F>> arc::context::operator[](
 
 template <typename F>
 inline arc::future<arc::result_of_t<F>> arc::context::operator[](
-	F * f, arc::key_of_t<F, 0> key0
+	F * f, const arc::key_of_t<F, 0> & key0
 #if arc_WITH_SOURCE_LOCATION
 	,
 	const std::source_location & sourceLocation
@@ -33,7 +37,7 @@ inline arc::future<arc::result_of_t<F>> arc::context::operator[](
 {
 	static_assert(arc::key_count_of_v<F> == 1);
 	return arc::future<arc::result_of_t<F>>{ store.retrieve_reference(
-		arc::detail::key{ f, *this, std::move(key0) }
+		arc::detail::key_view{ f, *this, key0 }
 #if arc_WITH_SOURCE_LOCATION
 		,
 		sourceLocation
@@ -43,7 +47,7 @@ inline arc::future<arc::result_of_t<F>> arc::context::operator[](
 
 template <typename F>
 arc::future<arc::result_of_t<F>> arc::context::operator[](
-	F * f, arc::key_of_t<F, 0> key0, arc::key_of_t<F, 1> key1
+	F * f, const arc::key_of_t<F, 0> & key0, const arc::key_of_t<F, 1> & key1
 #if arc_WITH_SOURCE_LOCATION
 	,
 	const std::source_location & sourceLocation
@@ -52,7 +56,7 @@ arc::future<arc::result_of_t<F>> arc::context::operator[](
 {
 	static_assert(arc::key_count_of_v<F> == 2);
 	return arc::future<arc::result_of_t<F>>{ store.retrieve_reference(
-		arc::detail::key{ f, *this, std::move(key0), std::move(key1) }
+		arc::detail::key_view{ f, *this, key0, key1 }
 #if arc_WITH_SOURCE_LOCATION
 		,
 		sourceLocation
@@ -62,7 +66,8 @@ arc::future<arc::result_of_t<F>> arc::context::operator[](
 
 template <typename F>
 arc::future<arc::result_of_t<F>> arc::context::operator[](
-	F * f, arc::key_of_t<F, 0> key0, arc::key_of_t<F, 1> key1, arc::key_of_t<F, 2> key2
+	F * f, const arc::key_of_t<F, 0> & key0, const arc::key_of_t<F, 1> & key1,
+	const arc::key_of_t<F, 2> & key2
 #if arc_WITH_SOURCE_LOCATION
 	,
 	const std::source_location & sourceLocation
@@ -71,7 +76,7 @@ arc::future<arc::result_of_t<F>> arc::context::operator[](
 {
 	static_assert(arc::key_count_of_v<F> == 3);
 	return arc::future<arc::result_of_t<F>>{ store.retrieve_reference(
-		arc::detail::key{ f, *this, std::move(key0), std::move(key1), std::move(key2) }
+		arc::detail::key_view{ f, *this, key0, key1, key2 }
 #if arc_WITH_SOURCE_LOCATION
 		,
 		sourceLocation
@@ -81,8 +86,8 @@ arc::future<arc::result_of_t<F>> arc::context::operator[](
 
 template <typename F>
 arc::future<arc::result_of_t<F>> arc::context::operator[](
-	F * f, arc::key_of_t<F, 0> key0, arc::key_of_t<F, 1> key1, arc::key_of_t<F, 2> key2,
-	arc::key_of_t<F, 3> key3
+	F * f, const arc::key_of_t<F, 0> & key0, const arc::key_of_t<F, 1> & key1,
+	const arc::key_of_t<F, 2> & key2, const arc::key_of_t<F, 3> & key3
 #if arc_WITH_SOURCE_LOCATION
 	,
 	const std::source_location & sourceLocation
@@ -91,8 +96,7 @@ arc::future<arc::result_of_t<F>> arc::context::operator[](
 {
 	static_assert(arc::key_count_of_v<F> == 4);
 	return arc::future<arc::result_of_t<F>>{ store.retrieve_reference(
-		arc::detail::key{ f, *this, std::move(key0), std::move(key1), std::move(key2),
-						  std::move(key3) }
+		arc::detail::key_view{ f, *this, key0, key1, key2, key3 }
 #if arc_WITH_SOURCE_LOCATION
 		,
 		sourceLocation
@@ -102,8 +106,9 @@ arc::future<arc::result_of_t<F>> arc::context::operator[](
 
 template <typename F>
 arc::future<arc::result_of_t<F>> arc::context::operator[](
-	F * f, arc::key_of_t<F, 0> key0, arc::key_of_t<F, 1> key1, arc::key_of_t<F, 2> key2,
-	arc::key_of_t<F, 3> key3, arc::key_of_t<F, 4> key4
+	F * f, const arc::key_of_t<F, 0> & key0, const arc::key_of_t<F, 1> & key1,
+	const arc::key_of_t<F, 2> & key2, const arc::key_of_t<F, 3> & key3,
+	const arc::key_of_t<F, 4> & key4
 #if arc_WITH_SOURCE_LOCATION
 	,
 	const std::source_location & sourceLocation
@@ -112,8 +117,7 @@ arc::future<arc::result_of_t<F>> arc::context::operator[](
 {
 	static_assert(arc::key_count_of_v<F> == 5);
 	return arc::future<arc::result_of_t<F>>{ store.retrieve_reference(
-		arc::detail::key{ f, *this, std::move(key0), std::move(key1), std::move(key2),
-						  std::move(key3), std::move(key4) }
+		arc::detail::key_view{ f, *this, key0, key1, key2, key3, key4 }
 #if arc_WITH_SOURCE_LOCATION
 		,
 		sourceLocation
@@ -397,8 +401,9 @@ inline arc::future<T>::operator bool() const noexcept
 template <typename T>
 inline void arc::future<T>::async_wait_and_then(arc::function<void()> && callback) const
 {
-	if (bool notAdded =
-			!handle || !handle->second.try_add_continuation(std::move(callback), "function");
+	if (bool notAdded = !handle ||
+			!handle->second.try_add_continuation(
+				std::move(callback), "function", handle->first.get_table().memory_resource());
 		notAdded)
 		callback();
 }
@@ -417,7 +422,7 @@ inline arc::result<T> arc::future<T>::active_wait()
 {
 	arc_TRACE_EVENT_SCOPED(arc_TRACE_CORO);
 
-	if (handle)
+	if (handle && !handle->second.is_done())
 	{
 		std::stop_source stopSource;
 
@@ -435,29 +440,115 @@ inline arc::result<T> arc::future<T>::try_wait()
 	return impl::try_get_result(*this);
 }
 
+/**
+ * Suspends on a pending result without locking or allocating, the continuation node lives in the
+ * awaitable.
+ *
+ * The awaiter of an arc::coro whose run can be cancelled is resumed early with arc::cancelled if
+ * it is cancelled while it waits for the result. Its node is allocated and shared with the stack
+ * of the result, because the awaitable is gone once the awaiter has been resumed while the node
+ * stays in the stack until it is walked. The result and the stop callback race to claim the node.
+ */
 template <typename T>
-inline auto arc::future<T>::operator co_await()
+struct arc::future<T>::awaitable
 {
-	struct awaitable
+	/** Resumes the awaiter with arc::cancelled unless the result has resumed it already. */
+	struct abort
 	{
-		bool await_ready() const noexcept
+		void operator()() const
 		{
-			return !self.handle;
+			if (!a.shared->try_claim())
+				return;
+
+			a.cancelled = true;
+
+			if (a.shared->try_hand_off())
+				a.self.handle->first.get_ctx().schedule_on_worker_thread(a.awaiter);
 		}
 
-		bool await_suspend(std::coroutine_handle<> awaiter)
-		{
-			arc_CHECK_Precondition(self.handle);
+		awaitable & a;
+	};
+
+	~awaitable()
+	{
+		stopCallback.reset();
+		if (shared)
+			shared->release();
+	}
+
+	/** A published result is taken without suspending, that is a single load. */
+	bool await_ready() const noexcept
+	{
+		return !self.handle || self.handle->second.is_done();
+	}
+
+	template <typename Promise>
+	bool await_suspend(std::coroutine_handle<Promise> awaiter_)
+	{
+		arc_CHECK_Precondition(self.handle);
+
+		const arc::detail::zone_info zone = arc::detail::get_zone_info(awaiter_.address());
+		arc::detail::control_block & controlBlock = self.handle->second;
 
-			return self.handle->second.try_add_continuation(
-				awaiter, arc::detail::get_zone_info(awaiter.address()));
+		if constexpr (std::is_base_of_v<arc::detail::coro_promise_base, Promise>)
+		{
+			if (awaiter_.promise().cancellable())
+			{
+				using ownership = arc::detail::continuation::ownership;
+
+				awaiter = awaiter_;
+				arc::detail::continuation * const node = shared = arc::detail::continuation::make(
+					self.handle->first.get_table().memory_resource(), { awaiter, zone },
+					ownership::shared, awaiter);
+
+				/** Registered first because the awaiter may be resumed as soon as it is added. */
+				stopCallback.emplace(awaiter_.promise().stop_token(), abort{ *this });
+
+				/** Only node from here on, the awaitable may be gone once the node is added. */
+				bool resumeNow = false;
+				if (!controlBlock.try_add_continuation(*node))
+				{
+					node->release();
+					resumeNow = node->try_claim();
+				}
+
+				/** The stop callback has claimed the node and left resuming to this function. */
+				if (!resumeNow)
+					resumeNow = node->try_hand_off();
+
+				node->release();
+				return !resumeNow;
+			}
 		}
 
-		arc::result<T> await_resume() { return impl::get_result(self); }
+		return controlBlock.try_add_continuation(
+			node.emplace(arc::detail::scheduler::task{ std::coroutine_handle<>{ awaiter_ }, zone },
+						 arc::detail::continuation::ownership::awaiter, awaiter_));
+	}
+
+	arc::result<T> await_resume()
+	{
+		/** Waits for a callback that is still running, it reads the handle of self. */
+		stopCallback.reset();
+
+		if (cancelled)
+			throw arc::cancelled{};
 
-		arc::future<T> & self;
-	};
+		return impl::get_result(self);
+	}
+
+	arc::future<T> & self;
+	std::coroutine_handle<> awaiter = nullptr;
+	std::optional<std::stop_callback<abort>> stopCallback = std::nullopt;
+	bool cancelled = false;
+	/** The node of an awaiter that can be cancelled. */
+	arc::detail::continuation * shared = nullptr;
+	std::optional<arc::detail::continuation> node = std::nullopt;
+};
 
+template <typename T>
+inline auto arc::future<T>::operator co_await()
+{
 	return awaitable{ *this };
 }
 
@@ -698,6 +789,9 @@ void arc::detail::key_impl<F>::call(arc::detail::store_entry & storeEntry) const
 
 	promise.set_self_handle(arc::detail::handle{ &storeEntry });
 
+	if (ctx.options().cancelUnreferenced)
+		promise.set_stop_token(ctx.store.renew_stop_source(controlBlock), true);
+
 	ctx.schedule_on_worker_thread(std::coroutine_handle<>{ handle });
 }
 
@@ -712,3 +806,55 @@ void arc::context::set_caching_policy_global(arc::result<T> global)
 {
 	globals.add(std::move(global).extract_handle());
 }
+
+template <typename F>
+void arc::context::set_caching_policy_lru(F * f)
+{
+	store.set_lru_policy(f);
+}
+
+template <typename T>
+void arc::context::set_caching_policy_lru(arc::future<T> future)
+{
+	std::move(future).extract_handle()->second.lruPolicy.store(true, std::memory_order::relaxed);
+}
+
+template <typename T>
+void arc::context::set_caching_policy_lru(arc::result<T> result)
+{
+	std::move(result).extract_handle()->second.lruPolicy.store(true, std::memory_order::relaxed);
+}
+
+template <typename F>
+void arc::context::set_caching_policy_ttl(F * f, arc::duration timeToLive)
+{
+	store.set_ttl_policy(f, timeToLive);
+}
+
+template <typename T>
+void arc::context::set_caching_policy_ttl(arc::future<T> future, arc::duration timeToLive)
+{
+	std::move(future).extract_handle()->second.ttlPolicy.store(
+		timeToLive, std::memory_order::relaxed);
+}
+
+template <typename T>
+void arc::context::set_caching_policy_ttl(arc::result<T> result, arc::duration timeToLive)
+{
+	std::move(result).extract_handle()->second.ttlPolicy.store(
+		timeToLive, std::memory_order::relaxed);
+}
+
+template <typename F>
+void arc::context::set_destruction_policy_deferred(F * f)
+{
+	store.set_deferred_destruction(f);
+}
+
+template <typename F>
+void arc::context::set_storage_policy_dense(F * f, size_t keyCount)
+{
+	static_assert(
+		arc::detail::has_dense_key<F>(), "The only key of f must be an integral or an enum.");
+	store.set_dense_key_count(f, keyCount);
+}
@@ -4,10 +4,18 @@
 #include "arc/util/util.hpp"
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <span>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <variant>
 #include <vector>
+#if arc_COMPILER_IS_MSVC && defined(_M_X64)
+	#include <intrin.h>
+#endif
 
 namespace arc::util
 {
@@ -30,6 +38,12 @@ namespace arc::util
 
 	struct FNV_1a_64;
 
+	struct wyhash_64;
+
+	/** A contiguous range of these can be hashed as one block of bytes. */
+	template <typename T>
+	concept bytewise_hashable = std::is_scalar_v<T> && std::has_unique_object_representations_v<T>;
+
 	template <typename Hash>
 	void hash_append(Hash & hash, const std::monostate & value)
 	{
@@ -72,14 +86,61 @@ namespace arc::util
 			std::apply([&hash](const auto &... v) { (hash_append(hash, v), ...); }, value);
 	}
 
+	template <typename Hash, typename T, size_t Extent>
+	void hash_append(Hash & hash, std::span<T, Extent> value)
+	{
+		hash_append(hash, value.size());
+		if constexpr (bytewise_hashable<std::remove_cv_t<T>>)
+		{
+			hash.update(value.data(), value.size_bytes());
+		}
+		else
+		{
+			for (const auto & v : value)
+				hash_append(hash, v);
+		}
+	}
+
 	template <typename Hash, typename T>
 	void hash_append(Hash & hash, const std::vector<T> & value)
 	{
-		hash_append(hash, value.size());
-		for (const auto & v : value)
-			hash_append(hash, v);
+		hash_append(hash, std::span<const T>{ value });
+	}
+
+	template <typename Hash, typename T, size_t N>
+	void hash_append(Hash & hash, const std::array<T, N> & value)
+	{
+		hash_append(hash, std::span<const T>{ value });
 	}
 
+	/**
+	 * Estimates the memory owned by a value, which is charged against the byte budget of the LRU
+	 * caching policy. May be specialized for types that own heap memory.
+	 */
+	template <typename T>
+	struct memory_usage
+	{
+		size_t operator()(const T & value) const noexcept { return sizeof(T); }
+	};
+
+	template <typename C>
+	struct memory_usage<std::basic_string<C>>
+	{
+		size_t operator()(const std::basic_string<C> & value) const noexcept
+		{
+			return sizeof(value) + value.capacity() * sizeof(C);
+		}
+	};
+
+	template <typename T>
+	struct memory_usage<std::vector<T>>
+	{
+		size_t operator()(const std::vector<T> & value) const noexcept
+		{
+			return sizeof(value) + value.capacity() * sizeof(T);
+		}
+	};
+
 	template <typename Q, typename T = typename Q::value_type>
 	T queue_pop(Q & queue)
 	{
@@ -115,3 +176,126 @@ public:
 private:
 	uint64_t state{ 14695981039346656037ull };
 };
+
+/**
+ * Streaming variant of wyhash. Every update() is mixed in with 64x64->128 bit multiplications on
+ * whole words, large inputs are consumed 48 bytes at a time in three independent lanes.
+ *
+ * NOTE: Unlike FNV-1a the result depends on how the input is split in to update() calls, so the
+ *       same sequence of hash_append() calls must be used for equal values.
+ */
+struct arc::util::wyhash_64
+{
+public:
+	using result_type = uint64_t;
+
+	wyhash_64() = default;
+
+	void update(const void * data, size_t size) noexcept
+	{
+		const uint8_t * bytes = static_cast<const uint8_t *>(data);
+		uint64_t seed = state;
+		uint64_t a = 0;
+		uint64_t b = 0;
+
+		if (size <= 16)
+		{
+			if (size >= 4)
+			{
+				const size_t offset = (size >> 3) << 2;
+				a = (read_32(bytes) << 32) | read_32(bytes + offset);
+				b = (read_32(bytes + size - 4) << 32) | read_32(bytes + size - 4 - offset);
+			}
+			else if (size > 0)
+			{
+				a = (uint64_t(bytes[0]) << 16) | (uint64_t(bytes[size >> 1]) << 8) |
+					uint64_t(bytes[size - 1]);
+			}
+		}
+		else
+		{
+			size_t remaining = size;
+
+			if (remaining > 48)
+			{
+				uint64_t seed1 = seed;
+				uint64_t seed2 = seed;
+				do
+				{
+					seed = mix(read_64(bytes) ^ secret[1], read_64(bytes + 8) ^ seed);
+					seed1 = mix(read_64(bytes + 16) ^ secret[2], read_64(bytes + 24) ^ seed1);
+					seed2 = mix(read_64(bytes + 32) ^ secret[3], read_64(bytes + 40) ^ seed2);
+					bytes += 48;
+					remaining -= 48;
+				} while (remaining > 48);
+				seed ^= seed1 ^ seed2;
+			}
+
+			while (remaining > 16)
+			{
+				seed = mix(read_64(bytes) ^ secret[1], read_64(bytes + 8) ^ seed);
+				bytes += 16;
+				remaining -= 16;
+			}
+
+			a = read_64(bytes + remaining - 16);
+			b = read_64(bytes + remaining - 8);
+		}
+
+		a ^= secret[1];
+		b ^= seed;
+		multiply(a, b);
+		state = mix(a ^ secret[0] ^ size, b ^ secret[1]);
+	}
+
+	uint64_t result() const noexcept { return state; }
+
+private:
+	static constexpr uint64_t secret[4] = { 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull,
+											0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull };
+
+	static uint64_t read_64(const uint8_t * bytes) noexcept
+	{
+		uint64_t value;
+		std::memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+
+	static uint64_t read_32(const uint8_t * bytes) noexcept
+	{
+		uint32_t value;
+		std::memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+
+	/** Replaces a and b with the low and the high half of their 128 bit product. */
+	static void multiply(uint64_t & a, uint64_t & b) noexcept
+	{
+#if defined(__SIZEOF_INT128__)
+		/** __extension__ keeps -Wpedantic from warning about the non-standard type. */
+		__extension__ typedef unsigned __int128 u128;
+		const u128 product = static_cast<u128>(a) * b;
+		a = uint64_t(product);
+		b = uint64_t(product >> 64);
+#elif arc_COMPILER_IS_MSVC && defined(_M_X64)
+		a = _umul128(a, b, &b);
+#else
+		const uint64_t aHigh = a >> 32, aLow = uint32_t(a);
+		const uint64_t bHigh = b >> 32, bLow = uint32_t(b);
+		const uint64_t high = aHigh * bHigh, middle0 = aHigh * bLow, middle1 = aLow * bHigh;
+		const uint64_t low = aLow * bLow;
+		const uint64_t carry = ((low >> 32) + uint32_t(middle0) + uint32_t(middle1)) >> 32;
+		a = low + (middle0 << 32) + (middle1 << 32);
+		b = high + (middle0 >> 32) + (middle1 >> 32) + carry;
+#endif
+	}
+
+	static uint64_t mix(uint64_t a, uint64_t b) noexcept
+	{
+		multiply(a, b);
+		return a ^ b;
+	}
+
+private:
+	uint64_t state{ secret[0] };
+};
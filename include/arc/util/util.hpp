@@ -22,6 +22,7 @@ namespace arc
 
 	using clock = std::chrono::steady_clock;
 	using time_point = clock::time_point;
+	using duration = clock::duration;
 }
 
 namespace arc::util
@@ -81,6 +82,18 @@ namespace arc::util
 	template <typename Tuple>
 	using remove_tuple_const_reference_t = typename remove_tuple_const_reference<Tuple>::type;
 
+	template <typename Tuple>
+	struct add_tuple_const_reference;
+
+	template <typename... Args>
+	struct add_tuple_const_reference<std::tuple<arc::context &, Args...>>
+	{
+		using type = std::tuple<arc::context &, const Args &...>;
+	};
+
+	template <typename Tuple>
+	using add_tuple_const_reference_t = typename add_tuple_const_reference<Tuple>::type;
+
 	template <typename T>
 	concept scoped_enum = std::is_scoped_enum_v<T>;
 
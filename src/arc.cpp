@@ -7,9 +7,19 @@
 #include "arc/util/guard.hpp"
 #include "arc/util/on_scope_exit.hpp"
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
 #include <cstdio>
 #include <print>
+#include <random>
+#if arc_COMPILER_IS_MSVC
+	#include <intrin.h>
+#endif
+#if arc_PLATFORM_IS_LINUX
+	#include <sys/mman.h>
+#endif
 
 #define arc_SCHEDULER_TRACE_WORKER_LIFETIME 0
 
@@ -81,32 +91,125 @@ const char * arc::detail::leak_new_c_string(std::string_view string)
 
 namespace
 {
-	template <typename T, typename Q, typename C, typename M>
-	void ThreadSafePush(T && element, Q & queue, C & conditionVariable, M & mutex)
+	void CpuRelax()
+	{
+#if arc_COMPILER_IS_MSVC && (defined(_M_X64) || defined(_M_IX86))
+		_mm_pause();
+#elif (arc_COMPILER_IS_GCC || arc_COMPILER_IS_CLANG) && (defined(__x86_64__) || defined(__i386__))
+		__builtin_ia32_pause();
+#elif (arc_COMPILER_IS_GCC || arc_COMPILER_IS_CLANG) && defined(__aarch64__)
+		asm volatile("yield");
+#endif
+	}
+
+	/**
+	 * Calls ready until it returns true, the spin duration of idle has passed or stop has been
+	 * requested.
+	 *
+	 * \return Whether ready returned true.
+	 */
+	template <typename F>
+	bool SpinUntil(const arc::detail::scheduler::idle_policy & idle,
+				   const std::stop_token & stopToken, F && ready)
+	{
+		if (idle.spinDuration <= arc::duration::zero())
+			return false;
+
+		const arc::time_point until = arc::clock::now() + idle.spinDuration;
+
+		for (uint32_t i = 0; true; i++)
+		{
+			if (ready())
+				return true;
+
+			/** Reading the clock costs more than a look for work. */
+			if (stopToken.stop_requested() || (i % 64 == 0 && arc::clock::now() >= until))
+				return false;
+
+			if (idle.yield)
+				std::this_thread::yield();
+			else
+				CpuRelax();
+		}
+	}
+
+	template <typename T, typename Q, typename P>
+	void ThreadSafePush(T && element, Q & queue, P & work)
+	{
+		bool wake = false;
+		{
+			std::lock_guard lk{ work.mtx };
+			queue.emplace(std::move(element));
+			work.pendingCount.fetch_add(1, std::memory_order::relaxed);
+			wake = work.sleeperCount;
+		}
+		if (wake)
+			work.cv.notify_one();
+	}
+
+	template <typename Q, typename P>
+	void ThreadSafePushAll(std::span<arc::detail::scheduler::task> tasks, Q & queue, P & work)
+	{
+		size_t wakeCount = 0;
+		{
+			std::lock_guard lk{ work.mtx };
+			for (arc::detail::scheduler::task & task : tasks)
+				queue.emplace(std::move(task));
+			work.pendingCount.fetch_add(tasks.size(), std::memory_order::relaxed);
+			wakeCount = std::min(tasks.size(), work.sleeperCount);
+		}
+
+		for (size_t i = 0; i < wakeCount; i++)
+			work.cv.notify_one();
+	}
+
+	template <typename T, typename P>
+	arc::detail::timer_id ThreadSafeInsertTimer(arc::time_point timePoint, T && element, P & work)
 	{
-		arc::util::on_scope_exit _ = [&conditionVariable] { conditionVariable.notify_one(); };
-		std::lock_guard lk{ mutex };
-		queue.emplace(std::move(element));
+		arc::detail::timer_id id;
+		bool wake = false;
+		{
+			std::lock_guard lk{ work.mtx };
+			id = work.timers.push(timePoint, std::move(element));
+			wake = work.sleeperCount;
+		}
+		if (wake)
+			work.cv.notify_one();
+		return id;
 	}
 
-	template <typename T, typename V, typename C, typename M>
-	void ThreadSafeInsertSorted(T && element, V & vector, C & conditionVariable, M & mutex)
+	template <typename P>
+	bool ThreadSafeEraseTimer(const arc::detail::timer_id & id, P & work)
 	{
-		arc::util::on_scope_exit _ = [&conditionVariable] { conditionVariable.notify_one(); };
-		std::lock_guard lk{ mutex };
-		arc::util::insert_sorted(
-			vector, std::move(element),
-			[](const auto & lhs, const auto & rhs) { return lhs.first < rhs.first; });
+		std::optional<arc::detail::scheduler::task> task;
+		bool timersDrained = false;
+
+		{
+			std::lock_guard lk{ work.mtx };
+			task = work.timers.erase(id);
+			timersDrained = task && work.timers.empty() && work.sleeperCount;
+		}
+
+		/** Workers that are asked to stop wait for the pending timers. */
+		if (timersDrained)
+			work.cv.notify_all();
+
+		return task.has_value();
 	}
 
-	template <typename G, typename T, typename C, typename M, typename V>
+	template <typename P>
 	std::optional<arc::detail::scheduler::task> ThreadSafeWorkPop(
-		G & highPrioTasks, T & tasks, V & timedTasks, C & conditionVariable, M & mutex,
-		const std::stop_token & stopToken)
+		P & work, const std::stop_token & stopToken,
+		const arc::detail::scheduler::idle_policy & idle)
 	{
 		arc_TRACE_EVENT_SCOPED(arc_TRACE_WORKER_IDLE);
 
-		std::unique_lock lk{ mutex };
+		auto & highPrioTasks = work.highPrioTasks;
+		auto & tasks = work.tasks;
+		auto & timedTasks = work.timers;
+		auto & conditionVariable = work.cv;
+
+		std::unique_lock lk{ work.mtx };
 
 		bool timerReady = false;
 		bool haveValue = false;
@@ -116,39 +219,53 @@ namespace
 		auto waitPredicate = [&highPrioTasks, &timedTasks, &tasks, &timerReady, &haveValue,
 							  &stopRequested, &haveHighPrioTasks, &stopToken] {
 			haveHighPrioTasks = highPrioTasks.size();
-			timerReady = timedTasks.size() && timedTasks[0].first <= arc::clock::now();
+			timerReady = timedTasks.size() && timedTasks.next_time_point() <= arc::clock::now();
 			bool haveWorkScheduled = tasks.size();
 			stopRequested = !timedTasks.size() && stopToken.stop_requested();
 			haveValue = haveHighPrioTasks || timerReady || haveWorkScheduled || stopRequested;
 			return haveValue;
 		};
 
+		if (!waitPredicate() && idle.spinDuration > arc::duration::zero())
+		{
+			lk.unlock();
+			SpinUntil(idle, stopToken, [&work] {
+				return work.pendingCount.load(std::memory_order::relaxed) != 0;
+			});
+			lk.lock();
+			waitPredicate();
+		}
+
 		while (!haveValue)
 		{
+			work.sleeperCount++;
+
 			if (timedTasks.size())
 			{
-				arc::time_point until = timedTasks[0].first;
+				arc::time_point until = timedTasks.next_time_point();
 				conditionVariable.wait_until(lk, stopToken, until, waitPredicate);
 			}
 			else
 			{
 				conditionVariable.wait(lk, stopToken, waitPredicate);
 			}
+
+			work.sleeperCount--;
 		}
 
 		if (haveHighPrioTasks)
 		{
+			work.pendingCount.fetch_sub(1, std::memory_order::relaxed);
 			return arc::util::queue_pop(highPrioTasks);
 		}
 		else if (timerReady)
 		{
 			arc_CHECK_Assert(!!timedTasks.size());
-			arc::detail::scheduler::task handle = std::move(timedTasks.front().second);
-			timedTasks.erase(timedTasks.begin());
-			return handle;
+			return timedTasks.pop();
 		}
 		else if (tasks.size())
 		{
+			work.pendingCount.fetch_sub(1, std::memory_order::relaxed);
 			if constexpr (arc::detail::scheduler::ArcSchedulerWorkPool_USING_QUEUE)
 				return arc::util::queue_pop(tasks);
 			else
@@ -161,16 +278,362 @@ namespace
 
 		arc_CHECK_Require(false);
 	}
+
+	/**
+	 * How many awaiters a worker may still resume directly when a coroutine returns, see
+	 * coro_promise_base::publish_result(). Each transfer may grow the stack unless the compiler
+	 * turns it into a tail call, hence the bound. Renewed for every task of the worker threads,
+	 * zero elsewhere so that the main thread only runs what has been scheduled to it.
+	 */
+	constexpr size_t MaxInlineResumeDepth = 16;
+	thread_local size_t inlineResumeBudget = 0;
+
+	void RunTask(arc::detail::scheduler::task & task, bool workerThread)
+	{
+		inlineResumeBudget = workerThread ? MaxInlineResumeDepth : 0;
+		arc::util::on_scope_exit _ = [] { inlineResumeBudget = 0; };
+
+		arc_CHECK_Assert(task.function);
+		if (task.zone)
+		{
+			arc_TRACE_ZONE_SCOPE scope{ task.zone, arc_TRACE_CORO };
+			task.function();
+		}
+		else
+		{
+			task.function();
+		}
+	}
+
+	/** The scheduler the current thread is a worker of and its index among the workers. */
+	thread_local const arc::detail::scheduler * currentScheduler = nullptr;
+	thread_local size_t currentWorker = 0;
+
+	/** The stealing_pool the current thread is a worker of and the index of its deque. */
+	thread_local const void * currentStealingPool = nullptr;
+	thread_local size_t currentStealingWorker = 0;
+
+	/** A worker pops from the injection queue first on every this many pops. */
+	constexpr size_t StealingInjectedPollInterval = 61;
+	/** The task nodes a worker keeps for reuse, further ones are deleted. */
+	constexpr size_t StealingFreeTaskCapacity = 256;
+
+	template <typename P>
+	auto * StealingOwnDeque(P & pool)
+	{
+		return currentStealingPool == &pool ? &pool.deques[currentStealingWorker] : nullptr;
+	}
+
+	template <typename P>
+	auto * StealingOwnState(P & pool)
+	{
+		return currentStealingPool == &pool ? &pool.workerStates[currentStealingWorker] : nullptr;
+	}
+
+	/** Only called by workers, the tasks of other threads are injected by value. */
+	template <typename P>
+	arc::detail::scheduler::task * StealingNewTask(arc::detail::scheduler::task && task, P & pool)
+	{
+		auto & freeTasks = StealingOwnState(pool)->freeTasks;
+
+		if (freeTasks.empty())
+			return new arc::detail::scheduler::task{ std::move(task) };
+
+		arc::detail::scheduler::task * node = freeTasks.back().release();
+		freeTasks.pop_back();
+		*node = std::move(task);
+		return node;
+	}
+
+	/** Moves the task out of a node of a deque and keeps the node for reuse by this worker. */
+	template <typename P>
+	arc::detail::scheduler::task StealingTake(arc::detail::scheduler::task * task, P & pool)
+	{
+		std::unique_ptr<arc::detail::scheduler::task> node{ task };
+		arc::detail::scheduler::task result = std::move(*node);
+		*node = {};
+
+		if (auto * state = StealingOwnState(pool);
+			state && state->freeTasks.size() < StealingFreeTaskCapacity)
+			state->freeTasks.push_back(std::move(node));
+
+		return result;
+	}
+
+	template <typename P>
+	void StealingPush(arc::detail::scheduler::task && task, P & pool, bool highPrio)
+	{
+		if (auto * own = StealingOwnDeque(pool); own && !highPrio)
+		{
+			own->push(StealingNewTask(std::move(task), pool));
+
+			if (pool.sleeperCount.load(std::memory_order::seq_cst))
+			{
+				{
+					std::lock_guard lk{ pool.mtx };
+					pool.wakeEpoch++;
+				}
+				pool.cv.notify_one();
+			}
+			return;
+		}
+
+		bool wake = false;
+		{
+			std::lock_guard lk{ pool.mtx };
+			if (highPrio)
+			{
+				pool.injected.emplace_front(std::move(task));
+				pool.injectedHighPrioCount.fetch_add(1, std::memory_order::relaxed);
+			}
+			else
+				pool.injected.emplace_back(std::move(task));
+			pool.injectedCount.fetch_add(1, std::memory_order::seq_cst);
+
+			if (pool.sleeperCount.load(std::memory_order::seq_cst))
+			{
+				pool.wakeEpoch++;
+				wake = true;
+			}
+		}
+		if (wake)
+			pool.cv.notify_one();
+	}
+
+	template <typename P>
+	void StealingPushAll(std::span<arc::detail::scheduler::task> tasks, P & pool)
+	{
+		if (auto * own = StealingOwnDeque(pool))
+		{
+			for (arc::detail::scheduler::task & task : tasks)
+				own->push(StealingNewTask(std::move(task), pool));
+		}
+		else
+		{
+			std::lock_guard lk{ pool.mtx };
+			for (arc::detail::scheduler::task & task : tasks)
+				pool.injected.emplace_back(std::move(task));
+			pool.injectedCount.fetch_add(tasks.size(), std::memory_order::seq_cst);
+		}
+
+		if (!pool.sleeperCount.load(std::memory_order::seq_cst))
+			return;
+
+		size_t wakeCount = 0;
+		{
+			std::lock_guard lk{ pool.mtx };
+			pool.wakeEpoch++;
+			wakeCount = std::min(tasks.size(), pool.sleeperCount.load(std::memory_order::relaxed));
+		}
+		for (size_t i = 0; i < wakeCount; i++)
+			pool.cv.notify_one();
+	}
+
+	template <typename P>
+	arc::detail::timer_id StealingInsertTimer(
+		arc::time_point timePoint, arc::detail::scheduler::task && task, P & pool)
+	{
+		arc::detail::timer_id id;
+		bool wake = false;
+		{
+			std::lock_guard lk{ pool.mtx };
+			id = pool.timers.push(timePoint, std::move(task));
+
+			/** A sleeping worker has to wait for an earlier time point now. */
+			if (timePoint < pool.nextTimer.load(std::memory_order::relaxed))
+			{
+				pool.nextTimer.store(timePoint, std::memory_order::relaxed);
+				pool.wakeEpoch++;
+				wake = true;
+			}
+		}
+		if (wake)
+			pool.cv.notify_one();
+
+		return id;
+	}
+
+	template <typename P>
+	bool StealingEraseTimer(const arc::detail::timer_id & id, P & pool)
+	{
+		std::optional<arc::detail::scheduler::task> task;
+		bool timersDrained = false;
+
+		{
+			std::lock_guard lk{ pool.mtx };
+			task = pool.timers.erase(id);
+			if (!task)
+				return false;
+
+			pool.nextTimer.store(
+				pool.timers.size() ? pool.timers.next_time_point() : arc::time_point::max(),
+				std::memory_order::relaxed);
+
+			if (pool.timers.empty())
+			{
+				pool.wakeEpoch++;
+				timersDrained = true;
+			}
+		}
+
+		/** Workers that are asked to stop wait for the pending timers. */
+		if (timersDrained)
+			pool.cv.notify_all();
+
+		return true;
+	}
+
+	template <typename P>
+	std::optional<arc::detail::scheduler::task> StealingPopInjected(P & pool)
+	{
+		if (!pool.injectedCount.load(std::memory_order::seq_cst))
+			return std::nullopt;
+
+		std::lock_guard lk{ pool.mtx };
+		if (pool.injected.empty())
+			return std::nullopt;
+
+		arc::detail::scheduler::task task = std::move(pool.injected.front());
+		pool.injected.pop_front();
+		pool.injectedCount.fetch_sub(1, std::memory_order::relaxed);
+		if (pool.injectedHighPrioCount.load(std::memory_order::relaxed))
+			pool.injectedHighPrioCount.fetch_sub(1, std::memory_order::relaxed);
+		return task;
+	}
+
+	/**
+	 * Tries a due timer, the own deque, the injection queue and then the deques of the others.
+	 * The injection queue is tried first while it holds high priority tasks and on every
+	 * StealingInjectedPollInterval-th pop of a worker.
+	 */
+	template <typename P, typename R>
+	std::optional<arc::detail::scheduler::task> StealingPop(P & pool, R & random)
+	{
+		if (const arc::time_point nextTimer = pool.nextTimer.load(std::memory_order::relaxed);
+			nextTimer != arc::time_point::max() && nextTimer <= arc::clock::now())
+		{
+			std::lock_guard lk{ pool.mtx };
+			if (pool.timers.size() && pool.timers.next_time_point() <= arc::clock::now())
+			{
+				arc::detail::scheduler::task task = pool.timers.pop();
+				pool.nextTimer.store(
+					pool.timers.size() ? pool.timers.next_time_point() : arc::time_point::max(),
+					std::memory_order::relaxed);
+				return task;
+			}
+		}
+
+		auto * own = StealingOwnDeque(pool);
+		auto * state = StealingOwnState(pool);
+
+		const bool injectedFirst =
+			(state && ++state->popCount % StealingInjectedPollInterval == 0) ||
+			pool.injectedHighPrioCount.load(std::memory_order::relaxed);
+
+		if (injectedFirst)
+			if (std::optional task = StealingPopInjected(pool))
+				return task;
+
+		if (own)
+			if (arc::detail::scheduler::task * task = own->pop())
+				return StealingTake(task, pool);
+
+		if (!injectedFirst)
+			if (std::optional task = StealingPopInjected(pool))
+				return task;
+
+		const size_t first = random() % pool.workerCount;
+		for (size_t i = 0; i < pool.workerCount; i++)
+		{
+			auto & victim = pool.deques[(first + i) % pool.workerCount];
+			if (&victim == own)
+				continue;
+
+			/** Losing a race does not mean that the deque is empty. */
+			while (!victim.empty())
+				if (arc::detail::scheduler::task * task = victim.steal())
+					return StealingTake(task, pool);
+		}
+
+		return std::nullopt;
+	}
+
+	/**
+	 * Schedules the continuations of a stack taken from a control_block in batches.
+	 *
+	 * \param resumeInline If given, receives the first awaiter that can be resumed directly
+	 *        instead of being scheduled. Awaiters with a trace zone are always scheduled, only a
+	 *        task that is run by the scheduler is profiled as a zone of its own.
+	 */
+	void ScheduleContinuations(arc::detail::scheduler & scheduler,
+							   arc::detail::continuation * continuation,
+							   std::coroutine_handle<> * resumeInline = nullptr)
+	{
+		std::array<arc::detail::scheduler::task, 32> batch;
+		size_t batchSize = 0;
+
+		auto take = [&batch, &batchSize, resumeInline](arc::detail::continuation & node) {
+			if (resumeInline && !*resumeInline && node.coroutine && !node.task.zone)
+				*resumeInline = node.coroutine;
+			else
+				batch[batchSize++] = std::move(node.task);
+		};
+
+		while (continuation)
+		{
+			/** An awaiter may be gone as soon as its task has been scheduled. */
+			arc::detail::continuation * next = continuation->next;
+
+			switch (continuation->owner)
+			{
+			case arc::detail::continuation::ownership::awaiter:
+				take(*continuation);
+				break;
+			case arc::detail::continuation::ownership::stack:
+				take(*continuation);
+				continuation->destroy();
+				break;
+			case arc::detail::continuation::ownership::shared:
+				if (continuation->try_claim())
+					take(*continuation);
+				continuation->release();
+				break;
+			}
+
+			if (batchSize == batch.size())
+			{
+				scheduler.schedule(std::span{ batch }, false);
+				batchSize = 0;
+			}
+
+			continuation = next;
+		}
+
+		scheduler.schedule(std::span{ batch.data(), batchSize }, false);
+	}
 }
 
 arc::context::~context()
 {
+	store.stop_retaining();
+	store.request_stop();
 	store.set_empty_once_callback([this] { this->scheduler.request_stop(); });
 }
 
-arc::detail::scheduler::scheduler(std::thread::id mainThreadId, size_t workerThreadCount)
+arc::detail::scheduler::stealing_pool::stealing_pool(size_t workerCount)
+	: deques{ std::make_unique<arc::detail::work_stealing_deque<task>[]>(workerCount) }
+	, workerStates{ std::make_unique<worker_state[]>(workerCount) }
+	, workerCount{ workerCount }
+{}
+
+arc::detail::scheduler::scheduler(std::thread::id mainThreadId, size_t workerThreadCount,
+								  bool workStealing, const idle_policy & idle)
 	: mainThreadId{ mainThreadId }
+	, idle{ idle }
 {
+	if (workStealing && workerThreadCount)
+		stealing = std::make_unique<stealing_pool>(workerThreadCount);
+
 	arc_TRACE_CONTAINER_CONFIGURE(
 		workerThreadWork.highPrioTasks, "workerThreadWork.highPrioTasks.size()");
 	arc_TRACE_CONTAINER_CONFIGURE(workerThreadWork.tasks, "workerThreadWork.tasks.size()");
@@ -187,23 +650,64 @@ void arc::detail::scheduler::schedule(
 {
 	arc_CHECK_Require(task.function);
 
+	if (timePoint)
+	{
+		schedule_after(std::move(task), *timePoint, mainThread);
+		return;
+	}
+
+	if (stealing && !mainThread)
+		return StealingPush(std::move(task), *stealing, false);
+
 	work_pool & work = mainThread ? mainThreadWork : workerThreadWork;
+	ThreadSafePush(task, work.tasks, work);
+}
 
-	if (timePoint)
-		ThreadSafeInsertSorted(
-			work_pool::timed_task{ *timePoint, std::move(task) }, work.timers, work.cv, work.mtx);
-	else
-		ThreadSafePush(task, work.tasks, work.cv, work.mtx);
+void arc::detail::scheduler::schedule(std::span<task> tasks, bool mainThread)
+{
+	if (tasks.empty())
+		return;
+
+	if (stealing && !mainThread)
+		return StealingPushAll(tasks, *stealing);
+
+	work_pool & work = mainThread ? mainThreadWork : workerThreadWork;
+	ThreadSafePushAll(tasks, work.tasks, work);
+}
+
+arc::detail::timer_id arc::detail::scheduler::schedule_after(
+	task && task, arc::time_point timePoint, bool mainThread)
+{
+	arc_CHECK_Require(task.function);
+
+	if (stealing && !mainThread)
+		return StealingInsertTimer(timePoint, std::move(task), *stealing);
+
+	work_pool & work = mainThread ? mainThreadWork : workerThreadWork;
+	return ThreadSafeInsertTimer(timePoint, std::move(task), work);
+}
+
+bool arc::detail::scheduler::cancel(const arc::detail::timer_id & id, bool mainThread)
+{
+	if (stealing && !mainThread)
+		return StealingEraseTimer(id, *stealing);
+
+	work_pool & work = mainThread ? mainThreadWork : workerThreadWork;
+	return ThreadSafeEraseTimer(id, work);
 }
 
 void arc::detail::scheduler::schedule(task && task, bool mainThread, bool highPrio)
 {
 	arc_CHECK_Precondition(task.function);
+
+	if (stealing && !mainThread)
+		return StealingPush(std::move(task), *stealing, highPrio);
+
 	work_pool & work = mainThread ? mainThreadWork : workerThreadWork;
 	if (highPrio)
-		ThreadSafePush(std::move(task), work.highPrioTasks, work.cv, work.mtx);
+		ThreadSafePush(std::move(task), work.highPrioTasks, work);
 	else
-		ThreadSafePush(std::move(task), work.tasks, work.cv, work.mtx);
+		ThreadSafePush(std::move(task), work.tasks, work);
 }
 
 void arc::detail::scheduler::worker(std::stop_token stopToken, std::optional<size_t> workerIndex)
@@ -220,31 +724,109 @@ void arc::detail::scheduler::worker(std::stop_token stopToken, std::optional<siz
 	}
 #endif
 
+	if (workerIndex)
+	{
+		currentScheduler = this;
+		currentWorker = *workerIndex;
+	}
+
 	bool mainThread = mainThreadId == std::this_thread::get_id();
+
+	if (stealing && !mainThread)
+		return stealing_worker(std::move(stopToken), workerIndex);
+
 	work_pool & work = mainThread ? mainThreadWork : workerThreadWork;
 
 	while (true)
 	{
-		std::optional<arc::detail::scheduler::task> task = ThreadSafeWorkPop(
-			work.highPrioTasks, work.tasks, work.timers, work.cv, work.mtx, stopToken);
+		std::optional<arc::detail::scheduler::task> task = ThreadSafeWorkPop(work, stopToken, idle);
 
 		if (task)
+			RunTask(*task, !mainThread);
+		else
+			break;
+	}
+}
+
+void arc::detail::scheduler::stealing_worker(
+	std::stop_token stopToken, std::optional<size_t> workerIndex)
+{
+	stealing_pool & pool = *stealing;
+
+	if (workerIndex)
+	{
+		currentStealingPool = &pool;
+		currentStealingWorker = *workerIndex;
+	}
+
+	std::minstd_rand random{ uint32_t(
+		std::hash<std::thread::id>{}(std::this_thread::get_id()) | 1) };
+
+	while (true)
+	{
+		std::optional<task> task = StealingPop(pool, random);
+
+		if (!task)
 		{
-			arc_CHECK_Assert(task->function);
-			if (task->zone)
+			arc_TRACE_EVENT_SCOPED(arc_TRACE_WORKER_IDLE);
+
+			auto lookForTask = [&task, &pool, &random] {
+				task = StealingPop(pool, random);
+				return task.has_value();
+			};
+
+			if (SpinUntil(idle, stopToken, lookForTask))
 			{
-				arc_TRACE_ZONE_SCOPE scope{ task->zone, arc_TRACE_CORO };
-				task->function();
+				RunTask(*task, true);
+				continue;
 			}
-			else
+
+			size_t epoch = 0;
 			{
-				task->function();
+				std::lock_guard lk{ pool.mtx };
+				epoch = pool.wakeEpoch;
+			}
+
+			pool.sleeperCount.fetch_add(1, std::memory_order::seq_cst);
+			arc::util::on_scope_exit _ = [&pool] {
+				pool.sleeperCount.fetch_sub(1, std::memory_order::relaxed);
+			};
+
+			task = StealingPop(pool, random);
+
+			if (!task)
+			{
+				std::unique_lock lk{ pool.mtx };
+
+				bool stopRequested = false;
+				auto waitPredicate = [&pool, &stopToken, &stopRequested, epoch] {
+					const bool timerReady =
+						pool.timers.size() && pool.timers.next_time_point() <= arc::clock::now();
+					stopRequested = !pool.timers.size() && stopToken.stop_requested();
+					return stopRequested || pool.wakeEpoch != epoch || timerReady;
+				};
+
+				/** Once stop is requested the pending timers are awaited without spinning. */
+				if (pool.timers.size() && stopToken.stop_requested())
+					pool.cv.wait_until(lk, pool.timers.next_time_point(), waitPredicate);
+				else if (pool.timers.size())
+					pool.cv.wait_until(lk, stopToken, pool.timers.next_time_point(), waitPredicate);
+				else
+					pool.cv.wait(lk, stopToken, waitPredicate);
+
+				lk.unlock();
+
+				if (stopRequested)
+				{
+					task = StealingPop(pool, random);
+					if (!task)
+						break;
+				}
 			}
 		}
-		else
-		{
-			break;
-		}
+
+		if (task)
+			RunTask(*task, true);
 	}
 }
 
@@ -265,6 +847,14 @@ void arc::detail::scheduler::assist() { worker(stopSource.get_token(), std::null
 
 void arc::detail::scheduler::request_stop() { stopSource.request_stop(); }
 
+std::optional<size_t> arc::detail::scheduler::current_worker() const
+{
+	if (currentScheduler == this)
+		return currentWorker;
+	else
+		return std::nullopt;
+}
+
 arc::detail::scheduler::~scheduler()
 {
 	assist();
@@ -278,77 +868,238 @@ arc::detail::scheduler::~scheduler()
 	arc_CHECK_Require(workerThreadWork.timers.size() == 0);
 	arc_CHECK_Require(workerThreadWork.highPrioTasks.size() == 0);
 	arc_CHECK_Require(workerThreadWork.tasks.size() == 0);
+
+	if (stealing)
+	{
+		arc_CHECK_Require(stealing->timers.size() == 0);
+		arc_CHECK_Require(stealing->injected.size() == 0);
+		for (size_t i = 0; i < stealing->workerCount; i++)
+			arc_CHECK_Require(stealing->deques[i].empty());
+	}
 }
 
-void arc::detail::store::release_reference(arc::detail::handle && coroHandle)
+void arc::detail::store::release_reference(arc::detail::handle && coroHandle, bool retain)
 {
-	arc_TRACE_EVENT_SCOPED(arc_TRACE_CORO);
-
-	arc_CHECK_Precondition(coroHandle && coroHandle.storeEntry);
-	arc::detail::store_entry & storeEntry = *coroHandle.storeEntry;
-	arc::detail::control_block & controlBlock = coroHandle->second;
-	const arc::detail::key & theKey = coroHandle->first;
+	release_references({ &coroHandle, 1 }, retain);
+}
 
-	{
-		auto waiters = controlBlock.waiters.read_and_write();
+void arc::detail::store::release_references(std::span<arc::detail::handle> handles, bool retain)
+{
+	arc_TRACE_EVENT_SCOPED(arc_TRACE_CORO);
 
-		auto oldRefCount = controlBlock.referenceCount.fetch_sub(1, std::memory_order::acq_rel);
-		coroHandle.abandon();
-		arc_CHECK_Assert(oldRefCount > 0);
-		if (oldRefCount > 1)
-		{
-			return;
-		}
+	if (handles.empty())
+		return;
 
-		if (!*waiters)
-		{
-			waiters->emplace();
-		}
-	}
+	arc_CHECK_Precondition(handles.front() && handles.front().storeEntry);
+	/** All entries of a store belong to the same context. */
+	arc::context & ctx = handles.front()->first.get_ctx();
 
-	controlBlock.result.reset();
+	struct Released
+	{
+		arc::detail::store_entry * storeEntry = nullptr;
+		arc::detail::function_table::Shard * shard = nullptr;
+		uint64_t hash = 0;
+	};
 
-	auto dataHandle = data.read_and_write();
+	/** The entries whose reference count has been brought to zero by this call. */
+	std::vector<Released> released;
 
+	for (arc::detail::handle & coroHandle : handles)
 	{
-		auto waiters = controlBlock.waiters.read_and_write();
-		arc_CHECK_Assert(*waiters);
+		arc_CHECK_Precondition(coroHandle && coroHandle.storeEntry);
+		arc::detail::store_entry & storeEntry = *coroHandle.storeEntry;
+		arc::detail::control_block & controlBlock = coroHandle->second;
+		const arc::detail::key & theKey = coroHandle->first;
 
-		auto refCount = controlBlock.referenceCount.load(std::memory_order::acquire);
-		if (refCount > 0)
+		if (retain)
 		{
-			theKey.call(storeEntry);
-			return;
+			const arc::duration ttlPolicy =
+				std::max(controlBlock.ttlPolicy.load(std::memory_order::relaxed),
+						 theKey.get_table().ttlPolicy.load(std::memory_order::relaxed));
+
+			if (ttlPolicy > arc::duration::zero())
+			{
+				if (ttl.retain(coroHandle, arc::clock::now() + ttlPolicy))
+					continue;
+			}
+			else if (controlBlock.lruPolicy.load(std::memory_order::relaxed) ||
+					 theKey.get_table().lruPolicy.load(std::memory_order::relaxed))
+			{
+				if (lru.retain(coroHandle))
+					continue;
+			}
 		}
-		else
+
 		{
-			arc_CHECK_Assert(!(*waiters)->continuations.size());
+			std::lock_guard lk{ controlBlock.runMutex };
+
+			auto oldRefCount =
+				controlBlock.referenceCount.fetch_sub(1, std::memory_order::acq_rel);
+			coroHandle.abandon();
+			arc_CHECK_Assert(oldRefCount > 0);
+			if (oldRefCount > 1)
+			{
+				continue;
+			}
+
+			/**
+			 * The entry has been revived and released again before the release that brought the
+			 * count to zero first has decided its fate, that release will see the count again.
+			 */
+			if (controlBlock.releasing)
+			{
+				continue;
+			}
+
+			controlBlock.releasing = true;
+
+			/** A revived entry is computed again. */
+			arc::detail::continuation * done = controlBlock.done_sentinel();
+			controlBlock.continuations.compare_exchange_strong(
+				done, nullptr, std::memory_order::acq_rel);
 		}
+
+		/** Exceptions and references are cheap to destroy, only owned values are deferred. */
+		if (controlBlock.result.owns_value() &&
+			(theKey.get_table().deferredDestruction.load(std::memory_order::relaxed) ||
+			 (deferredDestructionBytes &&
+			  controlBlock.result.memory_usage() >= deferredDestructionBytes)))
+			reclaimer.reclaim(controlBlock.result.extract());
+		else
+			controlBlock.result.reset();
+
+		const uint64_t hash = theKey.hash_value();
+		released.push_back({ &storeEntry, &theKey.get_table().shard_of(hash), hash });
 	}
 
-#if 0
-	auto oldRefCount = controlBlock.referenceCount.fetch_sub(1, std::memory_order::acq_rel);
-	arc_CHECK_Assert(oldRefCount > 0);
-	if (oldRefCount > 1)
-		return;
-#endif
+	/** Continuations of callers that revived an entry but did not keep their reference. */
+	std::vector<arc::detail::continuation *> continuations;
+
+	/**
+	 * The recomputation of a revived entry is started after the shard lock has been released
+	 * because key::call() may run user code which in turn may lock other shards.
+	 */
+	std::vector<arc::detail::handle> revived;
+
+	size_t erasedCount = 0;
 
-	auto it = dataHandle->store.find(theKey);
-	arc_CHECK_Assert(it != dataHandle->store.end());
+	/** The entries of a shard are decided under a single acquisition of its lock. */
+	std::ranges::sort(released, std::ranges::less{}, &Released::shard);
 
+	for (auto it = released.begin(); it != released.end();)
 	{
-		arc_CHECK_Precondition(controlBlock.referenceCount.load(std::memory_order::relaxed) == 0);
-		dataHandle->store.erase(it);
+		arc::detail::function_table::Shard & shard = *it->shard;
+		std::lock_guard lk{ shard.writeMutex };
+
+		for (; it != released.end() && it->shard == &shard; ++it)
+		{
+			arc::detail::store_entry & storeEntry = *it->storeEntry;
+			arc::detail::control_block & controlBlock = storeEntry.second;
+
+			{
+				std::lock_guard runLock{ controlBlock.runMutex };
+				arc_CHECK_Assert(!controlBlock.is_done());
+
+				controlBlock.releasing = false;
+
+				auto refCount = controlBlock.referenceCount.load(std::memory_order::acquire);
+				if (refCount > 0)
+				{
+					revived.push_back(arc::detail::handle{ &storeEntry });
+					continue;
+				}
+
+				continuations.push_back(controlBlock.take_continuations(false));
+			}
+
+			arc_CHECK_Precondition(
+				controlBlock.referenceCount.load(std::memory_order::relaxed) == 0);
+			/** Unpublished before the entry is retired, so no new reader can find it. */
+			if (std::atomic<arc::detail::store_entry *> * slot = storeEntry.first.get_slot())
+				slot->store(nullptr, std::memory_order::seq_cst);
+			shard.table.erase(storeEntry, it->hash);
+			erasedCount++;
+		}
 	}
 
-	if (!dataHandle->store.size())
+	for (arc::detail::handle & entry : revived)
+		entry->first.call(*entry.storeEntry);
+
+	for (arc::detail::continuation * continuation : continuations)
+		ScheduleContinuations(ctx.scheduler, continuation);
+
+	if (erasedCount &&
+		entryCount.fetch_sub(erasedCount, std::memory_order::acq_rel) == erasedCount)
+		run_empty_once_callbacks();
+}
+
+void arc::detail::store::finish_cancelled(arc::detail::handle && coroHandle)
+{
+	arc_TRACE_EVENT_SCOPED(arc_TRACE_CORO);
+
+	arc_CHECK_Precondition(coroHandle && coroHandle.storeEntry);
+	arc::detail::store_entry & storeEntry = *coroHandle.storeEntry;
+	arc::detail::control_block & controlBlock = coroHandle->second;
+	const arc::detail::key & theKey = coroHandle->first;
+	arc::context & ctx = theKey.get_ctx();
+
+	/** Continuations of callers that did not keep a reference, they are run regardless. */
+	arc::detail::continuation * continuations = nullptr;
+
 	{
-		while (dataHandle->emptyOnceCallbacks.size())
+		const uint64_t hash = theKey.hash_value();
+		arc::detail::function_table::Shard & shard = theKey.get_table().shard_of(hash);
+		std::lock_guard lk{ shard.writeMutex };
+
+		/**
+		 * Under the shard lock only lookups without lock can add references. They can not add one
+		 * once the count is zero, so the entry is either removed or restarted, never abandoned.
+		 */
+		auto refCount = controlBlock.referenceCount.load(std::memory_order::acquire);
+		while (refCount == 1)
+			if (controlBlock.referenceCount.compare_exchange_weak(
+					refCount, 0, std::memory_order::acq_rel))
+				break;
+
+		if (refCount == 1)
 		{
-			dataHandle->emptyOnceCallbacks.front()();
-			dataHandle->emptyOnceCallbacks.pop();
+			coroHandle.abandon();
+
+			arc_CHECK_Assert(!controlBlock.is_done());
+			continuations = controlBlock.take_continuations(false);
+
+			if (std::atomic<arc::detail::store_entry *> * slot = theKey.get_slot())
+				slot->store(nullptr, std::memory_order::seq_cst);
+			shard.table.erase(storeEntry, hash);
 		}
 	}
+
+	if (coroHandle)
+	{
+		/** Requested again while it was being cancelled. */
+		theKey.call(storeEntry);
+		return;
+	}
+
+	ScheduleContinuations(ctx.scheduler, continuations);
+
+	if (entryCount.fetch_sub(1, std::memory_order::acq_rel) == 1)
+		run_empty_once_callbacks();
+}
+
+void arc::detail::store::run_empty_once_callbacks()
+{
+	auto callbacks = emptyOnceCallbacks.read_and_write();
+
+	/** An entry might have been inserted since the count dropped to zero. */
+	if (entryCount.load(std::memory_order::acquire))
+		return;
+
+	while (callbacks->size())
+	{
+		callbacks->front()();
+		callbacks->pop();
+	}
 }
 
 void arc::detail::store::set_empty_once_callback(arc::function<void()> && emptyOnceCallback)
@@ -356,17 +1107,376 @@ void arc::detail::store::set_empty_once_callback(arc::function<void()> && emptyO
 	if (!emptyOnceCallback)
 		return;
 
-	auto dataHandle = data.read_and_write();
+	auto callbacks = emptyOnceCallbacks.read_and_write();
 
-	if (!dataHandle->store.size())
+	if (!entryCount.load(std::memory_order::acquire))
 	{
-		arc_CHECK_Assert(!dataHandle->emptyOnceCallbacks.size());
+		arc_CHECK_Assert(!callbacks->size());
 		emptyOnceCallback();
 	}
 	else
 	{
-		dataHandle->emptyOnceCallbacks.push(std::move(emptyOnceCallback));
+		callbacks->push(std::move(emptyOnceCallback));
+	}
+}
+
+std::atomic<arc::detail::function_table *> & arc::detail::store::table_slot(size_t functionIndex)
+{
+	const size_t chunk = size_t(std::bit_width((functionIndex >> 3) + 1)) - 1;
+	const size_t offset = functionIndex - ((size_t(8) << chunk) - 8);
+
+	std::atomic<arc::detail::function_table *> * slots =
+		tableChunks[chunk].load(std::memory_order::acquire);
+
+	if (!slots)
+	{
+		auto newSlots = std::make_unique<std::atomic<arc::detail::function_table *>[]>(
+			size_t(8) << chunk);
+
+		if (tableChunks[chunk].compare_exchange_strong(
+				slots, newSlots.get(), std::memory_order::acq_rel, std::memory_order::acquire))
+			slots = newSlots.release();
+	}
+
+	return slots[offset];
+}
+
+arc::detail::function_table & arc::detail::store::insert_table(
+	std::atomic<arc::detail::function_table *> & slot, arc::detail::function_untyped_t function,
+	size_t tableShardCount)
+{
+	auto table =
+		std::make_unique<arc::detail::function_table>(function, tableShardCount, arena);
+
+#if arc_TRACE_INSTRUMENTATION_ENABLE
+	const size_t tableIndex = tableCount.fetch_add(1, std::memory_order::relaxed);
+	table->configure("arc::detail::store[" + std::to_string(tableIndex) + "]");
+#endif
+
+	/** Another thread may have inserted the table of the same function in the meantime. */
+	arc::detail::function_table * existing = nullptr;
+	if (!slot.compare_exchange_strong(
+			existing, table.get(), std::memory_order::acq_rel, std::memory_order::acquire))
+		return *existing;
+
+	return *table.release();
+}
+
+namespace
+{
+	/**
+	 * Insert-only hash set of the functions that have been given an index. Lookups do not lock,
+	 * replaced slot arrays are kept because a lookup may still be reading them.
+	 */
+	struct FunctionIndexRegistry
+	{
+		struct Slot
+		{
+			/** Published after index. */
+			std::atomic<arc::detail::function_untyped_t> function{ nullptr };
+			size_t index = 0;
+		};
+
+		struct SlotArray
+		{
+			explicit SlotArray(size_t size)
+				: mask{ size - 1 }
+				, slots{ std::make_unique<Slot[]>(size) }
+			{}
+
+			const size_t mask;
+			std::unique_ptr<Slot[]> slots;
+		};
+
+		std::atomic<SlotArray *> current;
+		std::mutex mtx;
+		/** Guarded by mtx. Every array that has been current, the last one is. */
+		std::vector<std::unique_ptr<SlotArray>> arrays;
+		/** Guarded by mtx. */
+		size_t count = 0;
+
+		FunctionIndexRegistry()
+		{
+			arrays.push_back(std::make_unique<SlotArray>(64));
+			current.store(arrays.back().get(), std::memory_order::release);
+		}
+
+		/** \return The slot of function or the empty slot that ends its probe sequence. */
+		static Slot & probe(const SlotArray & array, arc::detail::function_untyped_t function)
+		{
+			const uint64_t hash = reinterpret_cast<uintptr_t>(function) * 0x9E3779B97F4A7C15;
+
+			for (size_t i = size_t(hash >> 32);; i++)
+			{
+				Slot & slot = array.slots[i & array.mask];
+				arc::detail::function_untyped_t it = slot.function.load(std::memory_order::acquire);
+				if (!it || it == function)
+					return slot;
+			}
+		}
+
+		static void publish(Slot & slot, arc::detail::function_untyped_t function, size_t index)
+		{
+			slot.index = index;
+			slot.function.store(function, std::memory_order::release);
+		}
+
+		size_t index_of(arc::detail::function_untyped_t function)
+		{
+			if (Slot & slot = probe(*current.load(std::memory_order::acquire), function);
+				slot.function.load(std::memory_order::acquire) == function)
+				return slot.index;
+
+			std::lock_guard lk{ mtx };
+
+			/** Slots are only filled under the lock, an empty slot stays empty until we fill it. */
+			SlotArray * array = current.load(std::memory_order::relaxed);
+			if (Slot & slot = probe(*array, function);
+				slot.function.load(std::memory_order::relaxed) == function)
+				return slot.index;
+
+			/** Kept at most half full so that probe sequences stay short. */
+			if (2 * (count + 1) > array->mask + 1)
+			{
+				auto grown = std::make_unique<SlotArray>(2 * (array->mask + 1));
+				for (size_t i = 0; i <= array->mask; i++)
+					if (auto it = array->slots[i].function.load(std::memory_order::relaxed))
+						publish(probe(*grown, it), it, array->slots[i].index);
+
+				array = arrays.emplace_back(std::move(grown)).get();
+				current.store(array, std::memory_order::release);
+			}
+
+			publish(probe(*array, function), function, count);
+			return count++;
+		}
+	};
+
+	FunctionIndexRegistry & FunctionIndices()
+	{
+		/** Leaked, functions may be looked up while static objects are destroyed. */
+		static FunctionIndexRegistry * registry = new FunctionIndexRegistry;
+		return *registry;
+	}
+}
+
+size_t arc::detail::function_index(arc::detail::function_untyped_t function)
+{
+	return FunctionIndices().index_of(function);
+}
+
+arc::detail::function_table::function_table(arc::detail::function_untyped_t function,
+											size_t shardCount, std::pmr::memory_resource & resource)
+	: function{ function }
+	, resource{ resource }
+	, shards{ std::make_unique<Shard[]>(shardCount) }
+	, shardMask{ shardCount - 1 }
+	, shardShift{ 64 - std::max(std::countr_zero(shardCount), 1) }
+{
+	arc_CHECK_Precondition(std::has_single_bit(shardCount));
+
+	for (size_t i = 0; i < shardCount; i++)
+		shards[i].table.set_memory_resource(resource);
+}
+
+arc::detail::function_table::~function_table()
+{
+	const size_t keyCount = denseKeyCount.load(std::memory_order::acquire);
+	for (size_t i = 0; keyCount && i <= (keyCount - 1) / dense_chunk_size; i++)
+		delete[] denseChunks[i].load(std::memory_order::acquire);
+}
+
+void arc::detail::function_table::set_dense_key_count(size_t keyCount)
+{
+	arc_CHECK_Precondition(!denseKeyCount.load(std::memory_order::acquire) && !size());
+
+	if (!keyCount)
+		return;
+
+	denseChunks = std::make_unique<std::atomic<std::atomic<arc::detail::store_entry *> *>[]>(
+		(keyCount - 1) / dense_chunk_size + 1);
+	denseKeyCount.store(keyCount, std::memory_order::release);
+}
+
+std::atomic<arc::detail::store_entry *> * arc::detail::function_table::allocate_dense_chunk(
+	size_t chunk)
+{
+	std::atomic<arc::detail::store_entry *> * slots = nullptr;
+
+	auto newSlots = std::make_unique<std::atomic<arc::detail::store_entry *>[]>(dense_chunk_size);
+
+	if (denseChunks[chunk].compare_exchange_strong(
+			slots, newSlots.get(), std::memory_order::acq_rel, std::memory_order::acquire))
+		slots = newSlots.release();
+
+	return slots;
+}
+
+#if arc_TRACE_INSTRUMENTATION_ENABLE
+void arc::detail::function_table::configure(std::string_view name)
+{
+	for (size_t i = 0; i <= shardMask; i++)
+		arc_TRACE_CONTAINER_CONFIGURE(
+			shards[i].table, std::string{ name } + "[" + std::to_string(i) + "]");
+}
+#endif
+
+size_t arc::detail::function_table::size()
+{
+	size_t result = 0;
+	for (size_t i = 0; i <= shardMask; i++)
+	{
+		std::lock_guard lk{ shards[i].writeMutex };
+		result += shards[i].table.size();
+	}
+	return result;
+}
+
+arc::detail::entry_table::entry_table()
+	: buckets{ new bucket_array{ 16 } }
+{}
+
+arc::detail::entry_table::~entry_table()
+{
+	std::unique_ptr<bucket_array> array{ buckets.load(std::memory_order::relaxed) };
+	for (size_t i = 0; i <= array->mask; i++)
+	{
+		node * it = array->heads[i].load(std::memory_order::relaxed);
+		while (it)
+			delete_node(std::exchange(it, it->next.load(std::memory_order::relaxed)));
+	}
+
+	for (auto & [epoch, n] : retiredNodes)
+		delete_node(n);
+}
+
+void arc::detail::entry_table::erase(const arc::detail::store_entry & entry, uint64_t hash)
+{
+	bucket_array * array = buckets.load(std::memory_order::relaxed);
+
+	std::atomic<node *> * link = &array->heads[hash & array->mask];
+	node * it = link->load(std::memory_order::relaxed);
+	while (it && &it->entry != &entry)
+	{
+		link = &it->next;
+		it = link->load(std::memory_order::relaxed);
+	}
+
+	arc_CHECK_Precondition(it);
+
+	/** Readers standing on the node keep following its next pointer, which is left intact. */
+	link->store(it->next.load(std::memory_order::relaxed), std::memory_order::seq_cst);
+	retiredNodes.emplace_back(arc::detail::epoch_domain::advance(), it);
+
+	count--;
+	Plot(int64_t(count));
+
+	try_reclaim();
+}
+
+void arc::detail::entry_table::grow()
+{
+	bucket_array * oldArray = buckets.load(std::memory_order::relaxed);
+	auto newArray = std::make_unique<bucket_array>(2 * (oldArray->mask + 1));
+
+	/**
+	 * Nodes are relinked one by one. A concurrent reader can be diverted into a chain of the new
+	 * array and miss its entry, but the chains stay acyclic and every node stays allocated.
+	 */
+	for (size_t i = 0; i <= oldArray->mask; i++)
+	{
+		node * it = oldArray->heads[i].load(std::memory_order::relaxed);
+		while (it)
+		{
+			node * next = it->next.load(std::memory_order::relaxed);
+			std::atomic<node *> & head = newArray->heads[it->hash & newArray->mask];
+			it->next.store(head.load(std::memory_order::relaxed), std::memory_order::seq_cst);
+			head.store(it, std::memory_order::relaxed);
+			it = next;
+		}
+	}
+
+	buckets.store(newArray.release(), std::memory_order::seq_cst);
+	retiredArrays.emplace_back(arc::detail::epoch_domain::advance(), oldArray);
+
+	try_reclaim();
+}
+
+void arc::detail::entry_table::try_reclaim()
+{
+	if (!retiredNodes.size() && !retiredArrays.size())
+		return;
+
+	const uint64_t oldest = arc::detail::epoch_domain::oldest_reader_epoch();
+
+	auto nodesEnd = std::ranges::find_if(
+		retiredNodes, [oldest](const auto & retired) { return retired.first > oldest; });
+	for (auto it = retiredNodes.begin(); it != nodesEnd; ++it)
+		delete_node(it->second);
+	retiredNodes.erase(retiredNodes.begin(), nodesEnd);
+
+	retiredArrays.erase(retiredArrays.begin(),
+						std::ranges::find_if(retiredArrays, [oldest](const auto & retired) {
+							return retired.first > oldest;
+						}));
+}
+
+uint64_t arc::detail::epoch_domain::oldest_reader_epoch()
+{
+	uint64_t oldest = quiescent;
+	for (record * it = records.load(std::memory_order::acquire); it; it = it->next)
+		oldest = std::min(oldest, it->epoch.load(std::memory_order::seq_cst));
+	return oldest;
+}
+
+arc::detail::epoch_domain::record & arc::detail::epoch_domain::acquire_record() noexcept
+{
+	/** Releases the record when the thread exits. */
+	struct owner
+	{
+		record * claimed = nullptr;
+
+		~owner()
+		{
+			localRecord = nullptr;
+			claimed->inUse.store(false, std::memory_order::release);
+		}
+	};
+
+	thread_local owner threadOwner;
+
+	record * claimed = nullptr;
+	for (record * it = records.load(std::memory_order::acquire); it && !claimed; it = it->next)
+		if (!it->inUse.load(std::memory_order::relaxed) &&
+			!it->inUse.exchange(true, std::memory_order::acquire))
+			claimed = it;
+
+	if (!claimed)
+	{
+		claimed = new record;
+		claimed->inUse.store(true, std::memory_order::relaxed);
+		claimed->next = records.load(std::memory_order::relaxed);
+		while (!records.compare_exchange_weak(
+			claimed->next, claimed, std::memory_order::release, std::memory_order::relaxed))
+		{}
 	}
+
+	threadOwner.claimed = claimed;
+	localRecord = claimed;
+	return *claimed;
+}
+
+arc::detail::key::~key()
+{
+	if (static_cast<void *>(impl_) == buffer_)
+		impl_->~key_impl_base();
+	else
+		impl_->destroy(memory_resource());
+}
+
+std::pmr::memory_resource & arc::detail::key::memory_resource() const
+{
+	return table_.memory_resource();
 }
 
 arc::detail::handle::handle(arc::detail::store_entry * storeEntry)
@@ -375,6 +1485,14 @@ arc::detail::handle::handle(arc::detail::store_entry * storeEntry)
 	acquire();
 }
 
+arc::detail::handle arc::detail::handle::try_acquire(arc::detail::store_entry * storeEntry) noexcept
+{
+	handle result;
+	if (storeEntry->second.try_add_reference())
+		result.storeEntry = storeEntry;
+	return result;
+}
+
 arc::detail::handle::handle(const handle & other)
 	: storeEntry{ other.storeEntry }
 {
@@ -441,7 +1559,30 @@ arc::detail::store_entry * arc::detail::handle::operator->() const noexcept
 
 void arc::detail::control_block::add_reference() noexcept
 {
-	referenceCount.fetch_add(1, std::memory_order::relaxed);
+	if (try_add_reference())
+		return;
+
+	/**
+	 * Revives the entry. A release that brought the count to zero takes the result back under
+	 * the same lock, so neither this caller nor the lookups that follow it see the old result as
+	 * done.
+	 */
+	std::lock_guard lk{ runMutex };
+	referenceCount.fetch_add(1, std::memory_order::acq_rel);
+}
+
+bool arc::detail::control_block::try_add_reference() noexcept
+{
+	auto refCount = referenceCount.load(std::memory_order::relaxed);
+
+	while (refCount)
+	{
+		if (referenceCount.compare_exchange_weak(
+				refCount, refCount + 1, std::memory_order::acquire, std::memory_order::relaxed))
+			return true;
+	}
+
+	return false;
 }
 
 void arc::detail::control_block::remove_reference(arc::detail::handle && coroHandle)
@@ -454,6 +1595,18 @@ void arc::detail::control_block::remove_reference(arc::detail::handle && coroHan
 	{
 		arc_CHECK_Assert(refCount > 0);
 
+		if (refCount == 2 && hasStopSource.load(std::memory_order::relaxed))
+		{
+			if (try_remove_reference_and_cancel())
+			{
+				coroHandle.abandon();
+				return;
+			}
+
+			refCount = referenceCount.load(std::memory_order::acquire);
+			continue;
+		}
+
 		if (referenceCount.compare_exchange_weak(
 				refCount, refCount - 1, std::memory_order::acq_rel))
 		{
@@ -462,67 +1615,124 @@ void arc::detail::control_block::remove_reference(arc::detail::handle && coroHan
 		}
 	}
 
-	arc::context & ctx = coroHandle->first.get_ctx();
-
-	struct NonCopyableHandle
-	{
-		NonCopyableHandle(arc::detail::handle && handle)
-			: handle{ std::move(handle) }
-		{}
-		arc::detail::handle handle;
+	coroHandle->first.get_ctx().store.queue_release(std::move(coroHandle));
+}
 
-		NonCopyableHandle(const NonCopyableHandle &) = delete;
-		NonCopyableHandle & operator=(const NonCopyableHandle &) = delete;
-		NonCopyableHandle(NonCopyableHandle &&) = default;
-		NonCopyableHandle & operator=(NonCopyableHandle &&) = default;
-	};
+bool arc::detail::control_block::try_add_continuation(arc::detail::continuation & node)
+{
+	arc::detail::continuation * head = continuations.load(std::memory_order::acquire);
 
-	static_assert(sizeof(NonCopyableHandle) == sizeof(void *));
+	do
+	{
+		if (head == done_sentinel())
+			return false;
+		node.next = head;
+	} while (!continuations.compare_exchange_weak(
+		head, &node, std::memory_order::acq_rel, std::memory_order::acquire));
 
-	ctx.scheduler.schedule(
-		{
-#if arc_FUNCTION_IS_MOVE_ONLY
-			[handle = NonCopyableHandle{ std::move(coroHandle) }]() mutable {
-				arc::context & ctx = handle.handle->first.get_ctx();
-				ctx.store.release_reference(std::move(handle.handle));
-			},
-#else
-			[handle = std::make_shared<arc::detail::handle>(std::move(coroHandle))]() {
-				arc::context & ctx = (*handle)->first.get_ctx();
-				ctx.store.release_reference(std::move(*handle));
-			},
-#endif
-			"release_reference",
-		},
-		false, true);
+	return true;
 }
 
-bool arc::detail::control_block::try_add_continuation(
-	arc::function<void()> && continuation, arc::detail::zone_info zone)
+bool arc::detail::control_block::try_add_continuation(arc::function<void()> && continuation,
+														arc::detail::zone_info zone,
+														std::pmr::memory_resource & resource)
 {
 	arc_CHECK_Precondition(continuation);
 
-	auto comp = waiters.read_and_write();
-	if (!comp->has_value())
+	if (is_done())
 		return false;
-	(*comp)->continuations.emplace_back(
-		arc::detail::control_block::Waiters::Continuation{ std::move(continuation), zone });
-	return true;
+
+	auto * node = arc::detail::continuation::make(
+		resource, { std::move(continuation), zone }, arc::detail::continuation::ownership::stack);
+
+	if (try_add_continuation(*node))
+		return true;
+
+	continuation = std::move(node->task.function);
+	node->destroy();
+	return false;
 }
 
-arc::detail::control_block::~control_block()
+arc::detail::continuation * arc::detail::control_block::take_continuations(bool done)
 {
-	arc_CHECK_Precondition(referenceCount.load(std::memory_order::relaxed) == 0);
-	arc_CHECK_Precondition(result.holds_nothing());
+	/** Sequentially consistent for lru_cache::retain() and lru_cache::charge(). */
+	arc::detail::continuation * head =
+		continuations.exchange(done ? done_sentinel() : nullptr, std::memory_order::seq_cst);
+	arc_CHECK_Assert(head != done_sentinel());
+	return head;
 }
 
-void arc::detail::coro_promise_base::unhandled_exception() noexcept
+std::stop_token arc::detail::control_block::renew_stop_source(const std::atomic_bool & stopAll)
 {
-	if (published_early_)
-		std::terminate(); /** Unsupported situation. Maybe the correct behavior would be to just
-							 return here instead of terminating and hence not reporting exceptions
-							 that happen after publishing the result. */
-	if (!self_handle_->second.result.holds_nothing())
+	std::lock_guard lk{ runMutex };
+	stopSource = std::stop_source{};
+	hasStopSource.store(true, std::memory_order::relaxed);
+
+	/** Checked under the lock that store::request_stop() takes to read the stop source. */
+	if (stopAll.load(std::memory_order::seq_cst) ||
+		referenceCount.load(std::memory_order::acquire) == 1)
+		stopSource.request_stop();
+
+	return stopSource.get_token();
+}
+
+std::stop_source arc::detail::control_block::stop_source_of_run()
+{
+	std::lock_guard lk{ runMutex };
+	return !is_done() ? stopSource : std::stop_source{ std::nostopstate };
+}
+
+bool arc::detail::control_block::try_remove_reference_and_cancel()
+{
+	std::stop_source source{ std::nostopstate };
+
+	{
+		std::lock_guard lk{ runMutex };
+
+		size_t refCount = 2;
+		if (!referenceCount.compare_exchange_strong(refCount, 1, std::memory_order::acq_rel))
+			return false;
+
+		/** The remaining reference is the handle of the computation itself. */
+		if (!is_done())
+			source = stopSource;
+	}
+
+	/**
+	 * Outside of the lock because the stop callbacks remove continuations of other entries. Only
+	 * the copy of the stop source is used since the entry may be gone by now.
+	 */
+	source.request_stop();
+
+	return true;
+}
+
+arc::detail::control_block::~control_block()
+{
+	arc_CHECK_Precondition(referenceCount.load(std::memory_order::relaxed) == 0);
+	arc_CHECK_Precondition(result.holds_nothing());
+}
+
+void arc::detail::coro_promise_base::unhandled_exception() noexcept
+{
+	if (published_early_)
+		std::terminate(); /** Unsupported situation. Maybe the correct behavior would be to just
+							 return here instead of terminating and hence not reporting exceptions
+							 that happen after publishing the result. */
+
+	/**
+	 * The result of a run that has been stopped is discarded, see ~coro_promise_base(). During
+	 * shutdown the exception is published instead, the result might still be awaited.
+	 */
+	if (stop_token_.stop_requested() && !self_handle_->first.get_ctx().store.stop_requested())
+	{
+		if (!self_handle_->second.result.holds_nothing())
+			self_handle_->second.result.reset();
+		cancelled_ = true;
+		return;
+	}
+
+	if (!self_handle_->second.result.holds_nothing())
 		std::terminate(); /** Unsupported situation. Probably unhandled_exception() after
 							 arc::promise_proxy::construct(). */
 
@@ -530,23 +1740,57 @@ void arc::detail::coro_promise_base::unhandled_exception() noexcept
 	publish_result();
 }
 
-void arc::detail::coro_promise_base::publish_result() noexcept /** Not exception-safe therefore
-																  noexcept */
+void arc::detail::coro_promise_base::publish_result(bool final) noexcept /** Not exception-safe
+																			therefore noexcept */
 {
-	auto comp = self_handle_->second.waiters.read_and_write();
+	arc_CHECK_Precondition(!self_handle_->second.is_done());
+
+	/**
+	 * The worker is about to be done with this coroutine, one awaiter is resumed on it right away
+	 * while the data that has just been produced is still in its cache.
+	 */
+	const bool resumeInline = final && inlineResumeBudget;
 
-	arc_CHECK_Precondition(comp->has_value());
+	ScheduleContinuations(self_handle_->first.get_ctx().scheduler,
+						  self_handle_->second.take_continuations(true),
+						  resumeInline ? &inline_continuation_ : nullptr);
 
-	for (arc::detail::control_block::Waiters::Continuation & continuation : (*comp)->continuations)
-		self_handle_->first.get_ctx().schedule_on_worker_thread(
-			std::move(continuation.function), continuation.zone);
+	/** Retained by the LRU caching policy before it was published. */
+	self_handle_->first.get_ctx().store.charge_retained(self_handle_->second);
 
-	comp->reset();
+	if (inline_continuation_)
+		inlineResumeBudget--;
+}
+
+std::coroutine_handle<> arc::detail::coro_promise_base::finish(
+	std::coroutine_handle<> self) noexcept
+{
+	std::coroutine_handle<> next = std::exchange(inline_continuation_, nullptr);
+	self.destroy();
+	return next ? next : std::noop_coroutine();
+}
+
+const std::stop_token & arc::detail::coro_promise_base::acquire_stop_token()
+{
+	if (!stop_token_.stop_possible())
+	{
+		arc::context & ctx = self_handle_->first.get_ctx();
+		stop_token_ = ctx.store.renew_stop_source(self_handle_->second);
+	}
+
+	return stop_token_;
 }
 
 arc::detail::coro_promise_base::~coro_promise_base()
 {
-	arc_CHECK_Precondition(!self_handle_->second.waiters.read_only()->has_value());
+	if (cancelled_)
+	{
+		arc::context & ctx = self_handle_->first.get_ctx();
+		ctx.store.finish_cancelled(std::move(self_handle_));
+		return;
+	}
+
+	arc_CHECK_Precondition(self_handle_->second.is_done());
 }
 
 arc::context::context()
@@ -555,7 +1799,11 @@ arc::context::context()
 
 arc::context::context(const arc::options & options)
 	: options_{ options }
-	, scheduler{ options.mainThreadId, options.workerThreadCount }
+	, store{ options.storeShardCount, options.lruMaxEntryCount, options.lruMaxBytes,
+			 options.workerThreadCount, options.deferredDestructionBytes, options.arenaChunkBytes,
+			 options.arenaHugePages }
+	, scheduler{ options.mainThreadId, options.workerThreadCount, options.workStealing,
+				 { options.idleSpinDuration, options.idleSpinYield } }
 {}
 
 const arc::options & arc::context::options() const { return options_; }
@@ -575,10 +1823,13 @@ void arc::context::schedule_on_worker_thread_after(
 		false);
 }
 
-void arc::context::schedule_on_worker_thread_after(
+arc::timer arc::context::schedule_on_worker_thread_after(
 	arc::function<void()> && task, arc::time_point timePoint, arc::detail::zone_info zone)
 {
-	return scheduler.schedule(detail::scheduler::task{ std::move(task), zone }, timePoint, false);
+	return { *this,
+			 scheduler.schedule_after(
+				 detail::scheduler::task{ std::move(task), zone }, timePoint, false),
+			 false };
 }
 
 void arc::context::schedule_on_worker_thread(
@@ -602,10 +1853,21 @@ void arc::context::schedule_on_main_thread_after(
 		true);
 }
 
-void arc::context::schedule_on_main_thread_after(
+arc::timer arc::context::schedule_on_main_thread_after(
 	arc::function<void()> && task, arc::time_point timePoint, arc::detail::zone_info zone)
 {
-	return scheduler.schedule(detail::scheduler::task{ std::move(task), zone }, timePoint, true);
+	return { *this,
+			 scheduler.schedule_after(
+				 detail::scheduler::task{ std::move(task), zone }, timePoint, true),
+			 true };
+}
+
+bool arc::timer::cancel()
+{
+	if (!ctx)
+		return false;
+
+	return ctx->scheduler.cancel(id, mainThread);
 }
 
 void arc::context::schedule_on_main_thread(
@@ -691,10 +1953,34 @@ arc::options arc::options::from_args(
 	size_t workerThreadCount = getArg(
 		"--workerThreadCount", args,
 		size_t(std::max<unsigned int>(std::thread::hardware_concurrency(), 2)) - 1);
+	size_t storeShardCount = getArg("--storeShardCount", args, options{}.storeShardCount);
+	size_t lruMaxEntryCount = getArg("--lruMaxEntryCount", args, options{}.lruMaxEntryCount);
+	size_t lruMaxBytes = getArg("--lruMaxBytes", args, options{}.lruMaxBytes);
+	size_t deferredDestructionBytes =
+		getArg("--deferredDestructionBytes", args, options{}.deferredDestructionBytes);
+	size_t arenaChunkBytes = getArg("--arenaChunkBytes", args, options{}.arenaChunkBytes);
+	const bool arenaHugePages = getArg<bool>("--arenaHugePages", args, false);
+	const bool cancelUnreferenced = getArg<bool>("--cancelUnreferenced", args, false);
+	const bool workStealing = getArg<bool>("--workStealing", args, false);
+	const size_t idleSpinMicroseconds = getArg(
+		"--idleSpinMicroseconds", args,
+		size_t(std::chrono::duration_cast<std::chrono::microseconds>(options{}.idleSpinDuration)
+				   .count()));
+	const bool idleSpinYield = getArg<bool>("--idleSpinYield", args, false);
 	return {
 		.workerThreadCount = workerThreadCount,
 		.mainThreadId = withMainThread ? std::this_thread::get_id() : std::thread::id{},
 		.args = std::move(args),
+		.storeShardCount = storeShardCount,
+		.lruMaxEntryCount = lruMaxEntryCount,
+		.lruMaxBytes = lruMaxBytes,
+		.deferredDestructionBytes = deferredDestructionBytes,
+		.arenaChunkBytes = arenaChunkBytes,
+		.arenaHugePages = arenaHugePages,
+		.cancelUnreferenced = cancelUnreferenced,
+		.workStealing = workStealing,
+		.idleSpinDuration = std::chrono::microseconds{ idleSpinMicroseconds },
+		.idleSpinYield = idleSpinYield,
 	};
 }
 
@@ -710,38 +1996,786 @@ void arc::detail::globals::add(arc::detail::handle && global)
 	store.read_and_write()->push(std::move(global));
 }
 
-arc::detail::store::store()
+arc::detail::store::store(size_t shardCount, size_t lruMaxEntryCount, size_t lruMaxBytes,
+						 size_t workerThreadCount, size_t deferredDestructionBytes,
+						 size_t arenaChunkBytes, bool arenaHugePages)
+	: arena{ arenaChunkBytes, arenaHugePages }
+	, shardCount{ std::bit_ceil(std::max<size_t>(shardCount, 1)) }
+	, lru{ *this, lruMaxEntryCount, lruMaxBytes }
+	, ttl{ *this }
+	, releases{ *this, workerThreadCount }
+	, deferredDestructionBytes{ deferredDestructionBytes }
+{}
+
+void arc::detail::store::stop_retaining()
+{
+	lru.close();
+	ttl.close();
+}
+
+arc::detail::lru_cache::lru_cache(
+	arc::detail::store & store, size_t maxEntryCount, size_t maxBytes)
+	: store{ store }
+	, maxEntryCount{ maxEntryCount }
+	, maxBytes{ maxBytes }
+{}
+
+bool arc::detail::lru_cache::retain(arc::detail::handle & storeEntry)
+{
+	arc::context & ctx = storeEntry->first.get_ctx();
+	arc::detail::control_block & controlBlock = storeEntry->second;
+
+	bool scheduleEviction = false;
+
+	{
+		auto s = state.read_and_write();
+
+		if (s->closed)
+			return false;
+
+		const uint64_t stamp = 2 * (retainCount.load(std::memory_order::relaxed) + 1);
+		retainCount.store(stamp / 2, std::memory_order::relaxed);
+		controlBlock.lruStamp.store(stamp, std::memory_order::relaxed);
+		controlBlock.lruBytes = 0;
+
+		/**
+		 * Either this sees the result published or charge() sees the flag, see
+		 * coro_promise_base::publish_result().
+		 */
+		controlBlock.lruUncharged.store(true, std::memory_order::seq_cst);
+		if (controlBlock.continuations.load(std::memory_order::seq_cst) ==
+			controlBlock.done_sentinel())
+			charge_locked(*s, controlBlock);
+
+		s->entries.push_back({ std::move(storeEntry), stamp });
+		std::ranges::push_heap(s->entries, older);
+
+		if (over_budget(*s) && !s->evictionScheduled)
+			scheduleEviction = s->evictionScheduled = true;
+	}
+
+	/** Evicting is left to a worker, it releases entries which might destroy large results. */
+	if (scheduleEviction)
+		ctx.schedule_on_worker_thread([this] { evict(); }, "arc::detail::lru_cache::evict");
+
+	return true;
+}
+
+void arc::detail::lru_cache::charge(arc::detail::control_block & controlBlock)
+{
+	if (!controlBlock.lruUncharged.load(std::memory_order::seq_cst))
+		return;
+
+	arc::context * ctx = nullptr;
+
+	{
+		auto s = state.read_and_write();
+
+		charge_locked(*s, controlBlock);
+
+		if (over_budget(*s) && !s->evictionScheduled && s->entries.size())
+		{
+			s->evictionScheduled = true;
+			ctx = &s->entries.front().storeEntry->first.get_ctx();
+		}
+	}
+
+	if (ctx)
+		ctx->schedule_on_worker_thread([this] { evict(); }, "arc::detail::lru_cache::evict");
+}
+
+void arc::detail::lru_cache::charge_locked(State & s, arc::detail::control_block & controlBlock)
 {
-	arc_TRACE_CONTAINER_CONFIGURE(data.read_and_write()->store, "arc::detail::store");
+	/** Also false if the entry has been evicted in the meantime. */
+	if (!controlBlock.lruUncharged.exchange(false, std::memory_order::relaxed))
+		return;
+
+	controlBlock.lruBytes = controlBlock.result.memory_usage();
+	s.bytes += controlBlock.lruBytes;
+}
+
+void arc::detail::lru_cache::evict()
+{
+	std::vector<arc::detail::handle> evicted;
+
+	{
+		auto s = state.read_and_write();
+
+		s->evictionScheduled = false;
+
+		while (s->entries.size() && over_budget(*s))
+		{
+			std::ranges::pop_heap(s->entries, older);
+			Entry & entry = s->entries.back();
+			arc::detail::control_block & controlBlock = entry.storeEntry->second;
+
+			/** Used since it was pushed, it goes back with its new stamp. */
+			if (const uint64_t stamp = controlBlock.lruStamp.load(std::memory_order::relaxed);
+				stamp > entry.stamp)
+			{
+				entry.stamp = stamp;
+				std::ranges::push_heap(s->entries, older);
+				continue;
+			}
+
+			controlBlock.lruStamp.store(0, std::memory_order::relaxed);
+			controlBlock.lruUncharged.store(false, std::memory_order::relaxed);
+			s->bytes -= std::exchange(controlBlock.lruBytes, 0);
+			evicted.emplace_back(std::move(entry.storeEntry));
+			s->entries.pop_back();
+		}
+	}
+
+	store.release_references(evicted, false);
+}
+
+arc::detail::release_queue::release_queue(
+	arc::detail::store & store, size_t workerThreadCount)
+	: store{ store }
+	, laneCount{ workerThreadCount + 1 }
+	, lanes{ std::make_unique<Lane[]>(laneCount) }
+{}
+
+void arc::detail::release_queue::push(arc::detail::handle && storeEntry)
+{
+	arc::context & ctx = storeEntry->first.get_ctx();
+	const size_t lane =
+		std::min(ctx.scheduler.current_worker().value_or(laneCount - 1), laneCount - 1);
+
+	{
+		std::lock_guard lk{ lanes[lane].mtx };
+		lanes[lane].handles.emplace_back(std::move(storeEntry));
+		if (std::exchange(lanes[lane].drainScheduled, true))
+			return;
+	}
+
+	ctx.scheduler.schedule({ [this, lane] { drain(lane); }, "arc::detail::release_queue::drain" },
+						   false, true);
 }
 
-arc::detail::store::~store() { arc_CHECK_Precondition(!data.read_and_write()->store.size()); }
+void arc::detail::release_queue::drain(size_t lane)
+{
+	Lane & l = lanes[lane];
+	arc::context * ctx = nullptr;
+
+	{
+		std::lock_guard lk{ l.mtx };
+		std::swap(l.handles, l.draining);
+		ctx = &l.draining.front()->first.get_ctx();
+	}
+
+	store.release_references(l.draining);
+	l.draining.clear();
 
-arc::detail::handle arc::detail::store::retrieve_reference(
-	arc::detail::key && key
-#if arc_WITH_SOURCE_LOCATION
-	,
-	const std::source_location & sourceLocation
+	{
+		std::lock_guard lk{ l.mtx };
+		if (l.handles.empty())
+		{
+			l.drainScheduled = false;
+			return;
+		}
+	}
+
+	/** Rescheduled rather than looping, so that a busy lane does not hold up other tasks. */
+	ctx->scheduler.schedule(
+		{ [this, lane] { drain(lane); }, "arc::detail::release_queue::drain" }, false, true);
+}
+
+arc::detail::result_reclaimer::~result_reclaimer()
+{
+	if (!thread.joinable())
+		return;
+
+	/** The thread leaves once stop has been requested and no results are pending. */
+	thread.request_stop();
+	thread.join();
+}
+
+void arc::detail::result_reclaimer::reclaim(arc::detail::result_store && result)
+{
+	{
+		std::lock_guard lk{ mtx };
+		pending.emplace_back(std::move(result));
+		if (!thread.joinable())
+			thread = std::jthread{ [this](std::stop_token stopToken) { run(stopToken); } };
+	}
+
+	cv.notify_one();
+}
+
+void arc::detail::result_reclaimer::run(std::stop_token stopToken)
+{
+#if arc_TRACE_INSTRUMENTATION_ENABLE
+	tracy::SetThreadName("ArcReclaimer");
 #endif
-)
+
+	std::vector<arc::detail::result_store> batch;
+
+	while (true)
+	{
+		{
+			std::unique_lock lk{ mtx };
+			cv.wait(lk, stopToken, [this] { return !pending.empty(); });
+			if (pending.empty())
+				return;
+			std::swap(pending, batch);
+		}
+
+		arc_TRACE_EVENT_SCOPED(arc_TRACE_CORO);
+		batch.clear();
+	}
+}
+
+arc::detail::ttl_cache::ttl_cache(arc::detail::store & store)
+	: store{ store }
+{}
+
+bool arc::detail::ttl_cache::retain(arc::detail::handle & storeEntry, arc::time_point expiry)
 {
-	arc_TRACE_EVENT_SCOPED(arc_TRACE_CORO);
+	arc::context & ctx = storeEntry->first.get_ctx();
 
-	auto dataHandle = data.read_and_write();
+	auto s = state.read_and_write();
 
-	auto insertion = dataHandle->store.try_emplace(std::move(key));
-	auto it = insertion.first;
+	if (s->closed)
+		return false;
 
-	if (insertion.second)
+	s->entries.emplace(expiry, std::move(storeEntry));
+
+	if (!s->scheduledExpiry || expiry < *s->scheduledExpiry)
 	{
-		it->first.call(*it);
+		/** The timer of the later expiry would only find nothing to release. */
+		s->timer.cancel();
+		s->scheduledExpiry = expiry;
+		s->timer = ctx.schedule_on_worker_thread_after(
+			[this, expiry] { expire(expiry); }, expiry, "arc::detail::ttl_cache::expire");
 	}
 
-#if arc_TRACE_INSTRUMENTATION_ENABLE && arc_WITH_SOURCE_LOCATION
-	it->second.requestLocations.emplace_back(sourceLocation);
+	return true;
+}
+
+void arc::detail::ttl_cache::expire(arc::time_point timerExpiry)
+{
+	std::vector<arc::detail::handle> expired;
+
+	{
+		auto s = state.read_and_write();
+
+		const arc::time_point now = arc::clock::now();
+		while (s->entries.size() && s->entries.begin()->first <= now)
+		{
+			expired.emplace_back(std::move(s->entries.begin()->second));
+			s->entries.erase(s->entries.begin());
+		}
+
+		/** Timers that were superseded by an earlier expiry only release what has expired. */
+		if (s->scheduledExpiry == timerExpiry)
+		{
+			s->scheduledExpiry.reset();
+			s->timer = {};
+
+			if (s->entries.size())
+			{
+				const arc::time_point nextExpiry = s->entries.begin()->first;
+				arc::context & ctx = s->entries.begin()->second->first.get_ctx();
+				s->scheduledExpiry = nextExpiry;
+				s->timer = ctx.schedule_on_worker_thread_after(
+					[this, nextExpiry] { expire(nextExpiry); }, nextExpiry,
+					"arc::detail::ttl_cache::expire");
+			}
+		}
+	}
+
+	store.release_references(expired, false);
+}
+
+void arc::detail::ttl_cache::close()
+{
+	std::multimap<arc::time_point, arc::detail::handle> entries;
+
+	{
+		auto s = state.read_and_write();
+		s->closed = true;
+		std::swap(entries, s->entries);
+
+		/** Otherwise the scheduler would wait for the pending timer before it stops. */
+		s->timer.cancel();
+		s->timer = {};
+		s->scheduledExpiry.reset();
+	}
+
+	for (auto & [expiry, storeEntry] : entries)
+		store.release_reference(std::move(storeEntry), false);
+}
+
+void arc::detail::lru_cache::close()
+{
+	std::vector<Entry> entries;
+
+	{
+		auto s = state.read_and_write();
+		s->closed = true;
+		s->bytes = 0;
+		std::swap(entries, s->entries);
+
+		for (Entry & entry : entries)
+		{
+			entry.storeEntry->second.lruStamp.store(0, std::memory_order::relaxed);
+			entry.storeEntry->second.lruUncharged.store(false, std::memory_order::relaxed);
+			entry.storeEntry->second.lruBytes = 0;
+		}
+	}
+
+	for (Entry & entry : entries)
+		store.release_reference(std::move(entry.storeEntry), false);
+}
+
+void arc::detail::store::request_stop()
+{
+	stopRequested.store(true, std::memory_order::seq_cst);
+
+	std::vector<std::stop_source> sources;
+
+	for (size_t chunk = 0; chunk < tableChunks.size(); chunk++)
+	{
+		std::atomic<arc::detail::function_table *> * slots =
+			tableChunks[chunk].load(std::memory_order::acquire);
+		if (!slots)
+			continue;
+
+		for (size_t i = 0; i < (size_t(8) << chunk); i++)
+		{
+			if (arc::detail::function_table * table = slots[i].load(std::memory_order::acquire))
+			{
+				table->for_each_entry([&sources](arc::detail::store_entry & storeEntry) {
+					if (std::stop_source source = storeEntry.second.stop_source_of_run();
+						source.stop_possible())
+						sources.emplace_back(std::move(source));
+				});
+			}
+		}
+	}
+
+	/** Outside of the shard locks because the stop callbacks resume awaiters. */
+	for (std::stop_source & source : sources)
+		source.request_stop();
+}
+
+arc::detail::store::~store()
+{
+	arc_CHECK_Precondition(!entryCount.load(std::memory_order::acquire));
+
+	for (size_t chunk = 0; chunk < tableChunks.size(); chunk++)
+	{
+		std::atomic<arc::detail::function_table *> * slots =
+			tableChunks[chunk].load(std::memory_order::acquire);
+		if (!slots)
+			continue;
+
+		for (size_t i = 0; i < (size_t(8) << chunk); i++)
+		{
+			std::unique_ptr<arc::detail::function_table> table{ slots[i].load(
+				std::memory_order::acquire) };
+			arc_CHECK_Precondition(!table || !table->size());
+		}
+
+		delete[] slots;
+	}
+}
+
+namespace
+{
+	/** Size class i of the frame pool holds frames of FrameMinSize << i bytes. */
+	constexpr size_t FrameMinSize = 64;
+	constexpr size_t FrameClassCount = 7;
+	/** Frames are moved between a thread and the shared pool in batches of this many. */
+	constexpr size_t FrameBatchSize = 32;
+	/** The free frames a thread keeps per size class before it returns a batch. */
+	constexpr size_t FrameCacheCapacity = 2 * FrameBatchSize;
+	/** The batches the shared pool keeps per size class, further batches are deleted. */
+	constexpr size_t FrameSharedCapacity = 64;
+
+	size_t FrameSizeClass(size_t size) { return std::bit_width((size - 1) / FrameMinSize); }
+
+	/** An intrusive list of free frames of the same size class. */
+	struct FrameList
+	{
+		struct Node
+		{
+			Node * next = nullptr;
+		};
+
+		Node * head = nullptr;
+		size_t count = 0;
+
+		void push(void * frame)
+		{
+			head = ::new (frame) Node{ head };
+			count++;
+		}
+
+		void * pop()
+		{
+			Node * frame = head;
+			head = frame->next;
+			count--;
+			return frame;
+		}
+
+		/** Splits the first n frames off. */
+		FrameList split(size_t n)
+		{
+			arc_CHECK_Precondition(n && n <= count);
+			FrameList first{ head, n };
+			Node * last = head;
+			for (size_t i = 1; i < n; i++)
+				last = last->next;
+			head = std::exchange(last->next, nullptr);
+			count -= n;
+			return first;
+		}
+
+		/** Moves the frames of other to the front. */
+		void splice(FrameList && other)
+		{
+			if (!other.count)
+				return;
+			Node * last = other.head;
+			while (last->next)
+				last = last->next;
+			last->next = head;
+			head = std::exchange(other.head, nullptr);
+			count += std::exchange(other.count, 0);
+		}
+
+		void delete_all()
+		{
+			while (count)
+				::operator delete(pop());
+		}
+	};
+
+	struct FrameCache;
+
+	struct SharedFramePool
+	{
+		std::mutex mtx;
+		/** Guarded by mtx. */
+		std::array<std::vector<FrameList>, FrameClassCount> batches;
+		/** The size of batches, read without locking to skip the lock if there are none. */
+		std::array<std::atomic_size_t, FrameClassCount> batchCounts{};
+		/**
+		 * Guarded by mtx. Frames that have been given in lists other than a batch, for example by
+		 * threads without a cache, until they fill a batch.
+		 */
+		std::array<FrameList, FrameClassCount> partial;
+		/** Guarded by mtx. The caches of the running threads. */
+		std::vector<const FrameCache *> caches;
+		/** Guarded by mtx. The sums of the counters of the threads that have exited. */
+		arc::frame_counters exited;
+
+		/** Locks mtx. Only full batches take up a place in batches. */
+		void give(size_t sizeClass, FrameList && frames)
+		{
+			FrameList excess;
+
+			{
+				std::lock_guard lk{ mtx };
+
+				auto keep = [&](FrameList && batch) {
+					if (batches[sizeClass].size() < FrameSharedCapacity)
+						batches[sizeClass].push_back(std::exchange(batch, {}));
+					else
+						excess.splice(std::move(batch));
+				};
+
+				if (frames.count == FrameBatchSize)
+					keep(std::move(frames));
+				else
+				{
+					FrameList & pending = partial[sizeClass];
+					pending.splice(std::move(frames));
+					while (pending.count >= FrameBatchSize)
+						keep(pending.split(FrameBatchSize));
+				}
+
+				batchCounts[sizeClass].store(batches[sizeClass].size(), std::memory_order::relaxed);
+			}
+
+			excess.delete_all();
+		}
+
+		/** Locks mtx unless there is no batch. */
+		FrameList take(size_t sizeClass)
+		{
+			if (!batchCounts[sizeClass].load(std::memory_order::relaxed))
+				return {};
+
+			std::lock_guard lk{ mtx };
+			if (batches[sizeClass].empty())
+				return {};
+
+			FrameList batch = batches[sizeClass].back();
+			batches[sizeClass].pop_back();
+			batchCounts[sizeClass].store(batches[sizeClass].size(), std::memory_order::relaxed);
+			return batch;
+		}
+	};
+
+	/** Never destroyed, threads may still free frames while the program exits. */
+	SharedFramePool & SharedFrames()
+	{
+		static SharedFramePool * pool = new SharedFramePool;
+		return *pool;
+	}
+
+	/** The free frames of a thread. */
+	struct FrameCache
+	{
+		struct Counter
+		{
+			/** Only written by the owning thread, a plain store is enough. */
+			std::atomic_size_t value{ 0 };
+
+			void increment() { value.store(get() + 1, std::memory_order::relaxed); }
+			size_t get() const { return value.load(std::memory_order::relaxed); }
+		};
+
+		FrameCache();
+		~FrameCache();
+
+		void add_to(arc::frame_counters & counters) const
+		{
+			counters.allocations += allocations.get();
+			counters.cacheHits += cacheHits.get();
+			counters.heapAllocations += heapAllocations.get();
+			counters.batchesTaken += batchesTaken.get();
+			counters.batchesReturned += batchesReturned.get();
+		}
+
+		std::array<FrameList, FrameClassCount> lists;
+		Counter allocations;
+		Counter cacheHits;
+		Counter heapAllocations;
+		Counter batchesTaken;
+		Counter batchesReturned;
+	};
+
+	/** Set once the cache of the thread has been destroyed, frames bypass it afterwards. */
+	thread_local bool frameCacheDestroyed = false;
+
+	FrameCache::FrameCache()
+	{
+		SharedFramePool & pool = SharedFrames();
+		std::lock_guard lk{ pool.mtx };
+		pool.caches.push_back(this);
+	}
+
+	FrameCache::~FrameCache()
+	{
+		frameCacheDestroyed = true;
+
+		SharedFramePool & pool = SharedFrames();
+
+		for (size_t sizeClass = 0; sizeClass < FrameClassCount; sizeClass++)
+			if (lists[sizeClass].count)
+				pool.give(sizeClass, std::move(lists[sizeClass]));
+
+		std::lock_guard lk{ pool.mtx };
+		add_to(pool.exited);
+		std::erase(pool.caches, this);
+	}
+
+	FrameCache * ThisThreadFrames()
+	{
+		if (frameCacheDestroyed)
+			return nullptr;
+
+		thread_local FrameCache cache;
+		return &cache;
+	}
+}
+
+void * arc::detail::frame_pool::allocate(size_t size)
+{
+	const size_t sizeClass = FrameSizeClass(size);
+	FrameCache * cache = ThisThreadFrames();
+
+	if (cache)
+		cache->allocations.increment();
+
+	if (sizeClass >= FrameClassCount)
+	{
+		if (cache)
+			cache->heapAllocations.increment();
+		return ::operator new(size);
+	}
+
+	if (!cache)
+		return ::operator new(FrameMinSize << sizeClass);
+
+	FrameList & list = cache->lists[sizeClass];
+
+	if (!list.count)
+	{
+		list = SharedFrames().take(sizeClass);
+		if (list.count)
+			cache->batchesTaken.increment();
+	}
+
+	if (list.count)
+	{
+		cache->cacheHits.increment();
+		return list.pop();
+	}
+
+	cache->heapAllocations.increment();
+	return ::operator new(FrameMinSize << sizeClass);
+}
+
+void arc::detail::frame_pool::deallocate(void * frame, size_t size) noexcept
+{
+	const size_t sizeClass = FrameSizeClass(size);
+
+	if (sizeClass >= FrameClassCount)
+	{
+		::operator delete(frame);
+		return;
+	}
+
+	FrameCache * cache = ThisThreadFrames();
+
+	if (!cache)
+	{
+		FrameList batch;
+		batch.push(frame);
+		SharedFrames().give(sizeClass, std::move(batch));
+		return;
+	}
+
+	FrameList & list = cache->lists[sizeClass];
+	list.push(frame);
+
+	if (list.count > FrameCacheCapacity)
+	{
+		SharedFrames().give(sizeClass, list.split(FrameBatchSize));
+		cache->batchesReturned.increment();
+	}
+}
+
+namespace
+{
+	/** The stripe of an arc::detail::arena that the current thread uses. */
+	size_t ArenaStripe()
+	{
+		thread_local const size_t stripe = std::hash<std::thread::id>{}(std::this_thread::get_id());
+		return stripe;
+	}
+
+	/** The size of a transparent huge page on Linux. */
+	constexpr size_t HugePageSize = size_t(2) << 20;
+}
+
+arc::detail::arena::arena(size_t chunkBytes, bool hugePages)
+	: chunkBytes{ chunkBytes ? std::max(chunkBytes, slab_size) : 0 }
+	, chunkAlignment{ hugePages && arc_PLATFORM_IS_LINUX ? HugePageSize : size_t(4096) }
+	, hugePages{ hugePages && arc_PLATFORM_IS_LINUX }
+{}
+
+arc::detail::arena::~arena()
+{
+	for (std::byte * chunk : chunks)
+		::operator delete(chunk, std::align_val_t{ chunkAlignment });
+}
+
+size_t arc::detail::arena::size_class(size_t bytes, size_t alignment)
+{
+	const size_t sizeClass = std::bit_width((std::max<size_t>(bytes, 1) - 1) / min_block_size);
+
+	/** Blocks are aligned to their size, slabs and chunks to at least the largest size. */
+	if (sizeClass >= class_count || alignment > (min_block_size << sizeClass))
+		return class_count;
+
+	return sizeClass;
+}
+
+void * arc::detail::arena::do_allocate(size_t bytes, size_t alignment)
+{
+	const size_t sizeClass = size_class(bytes, alignment);
+
+	if (!chunkBytes || sizeClass == class_count)
+		return ::operator new(bytes, std::align_val_t{ alignment });
+
+	Stripe & stripe = stripes[ArenaStripe() % stripe_count];
+	std::lock_guard lk{ stripe.mtx };
+
+	if (free_block * block = stripe.freeBlocks[sizeClass])
+	{
+		stripe.freeBlocks[sizeClass] = block->next;
+		return block;
+	}
+
+	if (stripe.slabBegin[sizeClass] == stripe.slabEnd[sizeClass])
+	{
+		stripe.slabBegin[sizeClass] = allocate_slab();
+		stripe.slabEnd[sizeClass] = stripe.slabBegin[sizeClass] + slab_size;
+	}
+
+	return std::exchange(stripe.slabBegin[sizeClass],
+						 stripe.slabBegin[sizeClass] + (min_block_size << sizeClass));
+}
+
+void arc::detail::arena::do_deallocate(void * block, size_t bytes, size_t alignment)
+{
+	const size_t sizeClass = size_class(bytes, alignment);
+
+	if (!chunkBytes || sizeClass == class_count)
+	{
+		::operator delete(block, std::align_val_t{ alignment });
+		return;
+	}
+
+	/** Blocks of a size class are interchangeable, the block joins the stripe of this thread. */
+	Stripe & stripe = stripes[ArenaStripe() % stripe_count];
+	std::lock_guard lk{ stripe.mtx };
+	stripe.freeBlocks[sizeClass] = ::new (block) free_block{ stripe.freeBlocks[sizeClass] };
+}
+
+std::byte * arc::detail::arena::allocate_slab()
+{
+	std::lock_guard lk{ chunkMutex };
+
+	if (chunkBegin == chunkEnd)
+	{
+		/** Whole slabs, and whole huge pages if the chunk is backed by them. */
+		const size_t bytes = (chunkBytes + chunkAlignment - 1) / chunkAlignment * chunkAlignment /
+			slab_size * slab_size;
+
+		chunks.reserve(chunks.size() + 1);
+		auto * chunk = static_cast<std::byte *>(
+			::operator new(bytes, std::align_val_t{ chunkAlignment }));
+		chunks.push_back(chunk);
+
+#if arc_PLATFORM_IS_LINUX
+		if (hugePages)
+			madvise(chunk, bytes, MADV_HUGEPAGE);
 #endif
 
-	return arc::detail::handle{ &*it };
+		chunkBegin = chunk;
+		chunkEnd = chunk + bytes;
+	}
+
+	return std::exchange(chunkBegin, chunkBegin + slab_size);
+}
+
+arc::frame_counters arc::get_frame_counters()
+{
+	SharedFramePool & pool = SharedFrames();
+	std::lock_guard lk{ pool.mtx };
+
+	arc::frame_counters counters = pool.exited;
+	for (const FrameCache * cache : pool.caches)
+		cache->add_to(counters);
+	return counters;
 }
 
 #if arc_TRACE_INSTRUMENTATION_ENABLE && 0
@@ -4,9 +4,17 @@
 #include "testing_macros.hpp"
 
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 /**
  * A custom key must be equality comparable and hashable via hash_append().
@@ -31,6 +39,28 @@ namespace arc::util
 	}
 }
 
+/** Polls predicate for at most ten seconds, returns false if it did not become true. */
+template <typename Predicate>
+static bool bounded_wait(Predicate && predicate)
+{
+	const arc::time_point deadline = arc::clock::now() + std::chrono::seconds{ 10 };
+	while (!predicate())
+	{
+		if (arc::clock::now() > deadline)
+			return false;
+		std::this_thread::yield();
+	}
+	return true;
+}
+
+/** Waits until the tasks given to the only worker thread of ctx so far have run. */
+static bool drain_worker(arc::context & ctx)
+{
+	auto done = std::make_shared<std::atomic_bool>(false);
+	ctx.schedule_on_worker_thread([done] { *done = true; }, "drain_worker");
+	return bounded_wait([&done] { return done->load(); });
+}
+
 static arc::coro<const std::string> get_hello_world(arc::context & ctx)
 {
 	co_return "Hello, World!";
@@ -60,6 +90,12 @@ static arc::coro<const Vec3 * const> get_hello_tile(arc::context & ctx, const Ve
 	co_return &key;
 }
 
+static arc::coro<const std::vector<int64_t> * const> get_hello_path(
+	arc::context & ctx, const std::vector<int64_t> & key)
+{
+	co_return &key;
+}
+
 struct CoroBaseResult
 {
 	int value = 0;
@@ -133,6 +169,21 @@ TEST_CASE("Coro Synchronous Wait", "[Coro]")
 		CHECK(**result == Vec3{ 5, 13, 4 });
 	}
 
+	SECTION("use a contiguous key")
+	{
+		arc::context ctx;
+
+		const std::vector<int64_t> key{ 7, 3, 21, 4 };
+
+		arc::result result1 = ctx[get_hello_path, key].active_wait();
+		arc::result result2 = ctx[get_hello_path, std::vector<int64_t>{ 7, 3, 21, 4 }].active_wait();
+		arc::result result3 = ctx[get_hello_path, std::vector<int64_t>{ 7, 3, 21 }].active_wait();
+
+		CHECK(**result1 == key);
+		CHECK(*result1 == *result2);
+		CHECK(*result1 != *result3);
+	}
+
 	SECTION("poll result")
 	{
 		arc::options options;
@@ -564,6 +615,37 @@ TEST_CASE("Coro multithreaded", "[Coro]")
 	CHECK(a.active_wait()->value == int64_t(7540113804746346429));
 }
 
+TEST_CASE("Coro Idle Policy", "[Coro]")
+{
+	/** Workers that sleep right away and workers that yield while they spin. */
+	for (arc::duration spin : { arc::duration::zero(), arc::duration{ std::chrono::seconds{ 1 } } })
+	{
+		arc::context ctx{ arc::options{
+			.workerThreadCount = 4, .idleSpinDuration = spin, .idleSpinYield = true } };
+
+		arc::future a = ctx[CoroRecursiveCachedFibonacci::arc_make, 92];
+		CHECK(a.active_wait()->value == int64_t(7540113804746346429));
+	}
+}
+
+TEST_CASE("Coro Dense Keys", "[Coro]")
+{
+	arc::context ctx{ arc::options{ .workerThreadCount = 4 } };
+
+	/** keys 64 to 92 and negative keys fall back to the hash table */
+	ctx.set_storage_policy_dense(CoroRecursiveCachedFibonacci::arc_make, 64);
+	ctx.set_storage_policy_dense(RecursiveFibonacci, 16);
+
+	arc::future a = ctx[CoroRecursiveCachedFibonacci::arc_make, 92];
+	CHECK(a.active_wait()->value == int64_t(7540113804746346429));
+
+	arc::future b = ctx[RecursiveFibonacci, -1];
+	CHECK_THROWS_AS(b.active_wait(), std::domain_error);
+
+	arc::future c = ctx[RecursiveFibonacci, 20];
+	CHECK(*c.active_wait() == int64_t(6765));
+}
+
 TEST_CASE("Coro get_key", "[Coro]")
 {
 	arc::context ctx;
@@ -605,6 +687,56 @@ TEST_CASE("Coro wait all", "[Coro]")
 	ctx[CoroAwaitsAll::arc_make].active_wait();
 }
 
+TEST_CASE("Coro Work Stealing", "[Coro]")
+{
+	arc::context ctx{ arc::options{ .workerThreadCount = 4, .workStealing = true } };
+
+	arc::future a = ctx[CoroRecursiveCachedFibonacci::arc_make, 92];
+	CHECK(a.active_wait()->value == int64_t(7540113804746346429));
+
+	ctx[CoroAwaitsAll::arc_make].active_wait();
+
+	std::atomic_int32_t counter = 0;
+	arc::time_point start = arc::clock::now();
+	for (int32_t i = 0; i < 3; i++)
+		ctx.schedule_on_worker_thread_after(
+			[&counter] { counter++; }, start + std::chrono::milliseconds{ i }, "increment");
+	CHECK(bounded_wait([&counter] { return counter == 3; }));
+}
+
+/** Reschedules itself onto the deque of its worker until stop is set or limit is reached. */
+struct Reschedule
+{
+	arc::context & ctx;
+	const std::atomic_bool & stop;
+	std::atomic_int64_t & count;
+	int64_t limit = 0;
+
+	void operator()() const
+	{
+		if (!stop && ++count < limit)
+			ctx.schedule_on_worker_thread(Reschedule{ *this }, "reschedule");
+	}
+};
+
+TEST_CASE("Work Stealing Injection", "[Coro]")
+{
+	arc::context ctx{ arc::options{ .workerThreadCount = 1, .workStealing = true } };
+
+	std::atomic_bool injectedRan = false;
+	std::atomic_int64_t count = 0;
+	const int64_t limit = 10'000'000;
+
+	ctx.schedule_on_worker_thread(Reschedule{ ctx, injectedRan, count, limit }, "reschedule");
+	REQUIRE(bounded_wait([&count] { return count > 0; }));
+
+	/** Injected while the deque of the only worker is never empty. */
+	ctx.schedule_on_worker_thread([&injectedRan] { injectedRan = true; }, "injected");
+
+	CHECK(bounded_wait([&injectedRan] { return injectedRan.load(); }));
+	CHECK(count < limit);
+}
+
 struct CoroInPlace
 {
 	arc_NON_COPYABLE_NON_MOVABLE(CoroInPlace);
@@ -680,6 +812,46 @@ TEST_CASE("Coro Funnel", "[Coro]")
 	arc::result r = a.active_wait();
 }
 
+static std::atomic_bool gateOpen = false;
+static std::atomic_bool gateEntered = false;
+static std::atomic_int gateAwaiterCount = 0;
+
+static arc::coro<int64_t> Gate(arc::context & ctx)
+{
+	/** Holds its worker until the test opens it. */
+	gateEntered = true;
+	CHECK(bounded_wait([] { return gateOpen.load(); }));
+	co_return 1;
+}
+
+static arc::coro<int64_t> AwaitGate(arc::context & ctx, const int64_t & i)
+{
+	gateAwaiterCount++;
+	co_return *co_await ctx[Gate] + i;
+}
+
+TEST_CASE("Many Awaiters", "[Coro]")
+{
+	/** The continuations of a result are scheduled in batches of 32 with a single lock each. */
+	for (bool workStealing : { false, true })
+	{
+		gateOpen = false;
+		gateAwaiterCount = 0;
+
+		arc::context ctx{ arc::options{ .workerThreadCount = 2, .workStealing = workStealing } };
+
+		std::vector<arc::future<int64_t>> futures;
+		for (int64_t i = 0; i < 100; i++)
+			futures.push_back(ctx[AwaitGate, i]);
+
+		CHECK(bounded_wait([] { return gateAwaiterCount == 100; }));
+		gateOpen = true;
+
+		for (int64_t i = 0; i < 100; i++)
+			CHECK(*futures[i].active_wait() == i + 1);
+	}
+}
+
 static std::string NonCoroFunction(arc::context & ctx) { return "Hello, World!"; }
 
 TEST_CASE("Non-Coro Function", "[Coro]")
@@ -721,6 +893,42 @@ TEST_CASE("Non-Coro Fibonacci", "[Coro]")
 	CHECK(*result == 55);
 }
 
+/** Each link completes while the link above waits, far more links than are resumed inline. */
+static arc::coro<int64_t> AwaitChain(arc::context & ctx, const int64_t & n)
+{
+	if (n == 0)
+		co_return 0;
+
+	arc::result below = co_await ctx[AwaitChain, n - 1];
+	co_return *below + 1;
+}
+
+TEST_CASE("Deep Await Chain", "[Coro]")
+{
+	arc::context ctx{ arc::options{ .workerThreadCount = 2 } };
+	arc::result result = ctx[AwaitChain, 5000].active_wait();
+	CHECK(result);
+	CHECK(*result == 5000);
+}
+
+TEST_CASE("Frame Counters", "[Coro]")
+{
+	const arc::frame_counters before = arc::get_frame_counters();
+
+	/** The threads of the second context reuse the frames freed by the threads of the first. */
+	for (int i = 0; i < 2; i++)
+	{
+		arc::context ctx{ arc::options{ .workerThreadCount = 2 } };
+		CHECK(*ctx[AwaitChain, 100].active_wait() == 100);
+	}
+
+	/** The worker threads have exited, so the counters are final. */
+	const arc::frame_counters after = arc::get_frame_counters();
+	CHECK(after.allocations >= before.allocations + 2 * 101);
+	CHECK(after.cacheHits + after.heapAllocations == after.allocations);
+	CHECK(after.cacheHits > before.cacheHits);
+}
+
 static arc::coro<std::string> TwoArgumentsFunction(
 	arc::context & ctx, const int64_t & i, const std::string & s)
 {
@@ -754,12 +962,384 @@ TEST_CASE("Two Arguments Function", "[Coro]")
 	CHECK(result3.get() == result7.get());
 }
 
+TEST_CASE("Sharded Lookup", "[Coro]")
+{
+	arc::context ctx{ arc::options{ .workerThreadCount = 2, .storeShardCount = 8 } };
+
+	static constexpr int64_t key_count = 500;
+	std::vector<arc::result<std::string>> expected;
+	for (int64_t i = 0; i < key_count; i++)
+		expected.push_back(ctx[TwoArgumentsFunction, i, "key "].active_wait());
+
+	/** Every thread finds the same entries while the others look them up in all shards. */
+	std::atomic_int32_t mismatches = 0;
+	std::vector<std::thread> threads;
+	for (int32_t t = 0; t < 4; t++)
+		threads.emplace_back([&ctx, &expected, &mismatches, t] {
+			for (int64_t n = 0; n < 4 * key_count; n++)
+			{
+				int64_t i = (n * (2 * t + 1)) % key_count;
+				arc::result result = ctx[TwoArgumentsFunction, i, "key "].active_wait();
+				if (result.get() != expected[i].get() || *result != "key " + std::to_string(i))
+					mismatches++;
+			}
+		});
+	for (std::thread & thread : threads)
+		thread.join();
+
+	CHECK(mismatches == 0);
+}
+
+TEST_CASE("Inline And Heap Keys", "[Coro]")
+{
+	arc::context ctx;
+
+	/** The key_impl of a short string fits inline in the key, that of a long one does not. */
+	const std::string shortString = "short";
+	const std::string longString(300, 'l');
+
+	for (int round = 0; round < 2; round++)
+	{
+		arc::result inlineResult = ctx[TwoArgumentsFunction, 1, shortString].active_wait();
+		arc::result heapResult = ctx[TwoArgumentsFunction, 1, longString].active_wait();
+
+		CHECK(*inlineResult == shortString + "1");
+		CHECK(*heapResult == longString + "1");
+		CHECK((inlineResult.get_key<std::string, 1>(TwoArgumentsFunction) == shortString));
+		CHECK((heapResult.get_key<std::string, 1>(TwoArgumentsFunction) == longString));
+		CHECK((heapResult.get_key<int64_t, 0>(TwoArgumentsFunction) == 1));
+
+		CHECK(ctx[TwoArgumentsFunction, 1, longString].active_wait().get() == heapResult.get());
+	}
+}
+
+/** Counts its copies, a lookup that finds an entry must not copy its arguments. */
+struct CountedKey
+{
+	CountedKey(int64_t value)
+		: value{ value }
+	{}
+
+	CountedKey(const CountedKey & other)
+		: value{ other.value }
+	{
+		copyCount++;
+	}
+
+	int64_t value = 0;
+
+	static inline std::atomic_int32_t copyCount = 0;
+
+	friend bool operator==(const CountedKey & lhs, const CountedKey & rhs) = default;
+};
+
+namespace arc::util
+{
+	template <typename Hash>
+	void hash_append(Hash & hash, const CountedKey & key)
+	{
+		hash_append(hash, key.value);
+	}
+}
+
+static arc::coro<int64_t> CountedKeyValue(arc::context & ctx, const CountedKey & key)
+{
+	co_return key.value;
+}
+
+TEST_CASE("Borrowed Key Lookup", "[Coro]")
+{
+	arc::context ctx;
+	const CountedKey key{ 42 };
+
+	arc::result first = ctx[CountedKeyValue, key].active_wait();
+	CHECK(*first == 42);
+	const int32_t copiesOfMiss = CountedKey::copyCount;
+	CHECK(copiesOfMiss >= 1);
+
+	for (int i = 0; i < 10; i++)
+	{
+		arc::result hit = ctx[CountedKeyValue, key].active_wait();
+		CHECK(hit.get() == first.get());
+	}
+	CHECK(CountedKey::copyCount == copiesOfMiss);
+
+	/** A different value is copied into a new entry. */
+	arc::result other = ctx[CountedKeyValue, CountedKey{ 43 }].active_wait();
+	CHECK(*other == 43);
+	CHECK(CountedKey::copyCount > copiesOfMiss);
+}
+
+static arc::coro<int64_t> Doubled(arc::context & ctx, const int64_t & n) { co_return 2 * n; }
+
+TEST_CASE("Concurrent Lookup Erase Grow", "[Coro]")
+{
+	arc::context ctx{ arc::options{ .workerThreadCount = 2, .storeShardCount = 1 } };
+
+	/** Found without locking while the table grows and entries around it are erased. */
+	arc::result held = ctx[Doubled, -1].active_wait();
+
+	std::atomic_int32_t mismatches = 0;
+	std::vector<std::thread> threads;
+	for (int32_t t = 0; t < 4; t++)
+		threads.emplace_back([&ctx, &held, &mismatches, t] {
+			for (int64_t round = 1; round <= 16; round++)
+			{
+				/** The threads share the keys of a round, the last one to drop them erases them. */
+				std::vector<arc::result<const int64_t>> results;
+				for (int64_t i = 0; i < 64 * round; i++)
+				{
+					int64_t n = (i * (2 * t + 1) + round * 1000) % (64 * round) + round * 1000;
+					results.push_back(ctx[Doubled, n].active_wait());
+					if (*results.back() != 2 * n)
+						mismatches++;
+					if (ctx[Doubled, -1].active_wait().get() != held.get())
+						mismatches++;
+				}
+			}
+		});
+	for (std::thread & thread : threads)
+		thread.join();
+
+	CHECK(mismatches == 0);
+	CHECK(*held == -2);
+}
+
+static arc::coro<int64_t> AwaitDoubled(arc::context & ctx, const int64_t & n, const int64_t & t)
+{
+	co_return *co_await ctx[Doubled, n] + t;
+}
+
+TEST_CASE("Revive Awaited Entries", "[Coro]")
+{
+	arc::context ctx{ arc::options{ .workerThreadCount = 2 } };
+
+	/**
+	 * The threads share a few keys and drop every reference right away, so awaiters push their
+	 * continuations onto entries that are released and revived under them.
+	 */
+	std::atomic_int32_t mismatches = 0;
+	std::vector<std::thread> threads;
+	for (int64_t t = 0; t < 4; t++)
+		threads.emplace_back([&ctx, &mismatches, t] {
+			for (int64_t n = 0; n < 2000; n++)
+			{
+				int64_t k = (n + t) % 4;
+				if (*ctx[AwaitDoubled, k, t].active_wait() != 2 * k + t)
+					mismatches++;
+				if (*ctx[Doubled, k].active_wait() != 2 * k)
+					mismatches++;
+			}
+		});
+	for (std::thread & thread : threads)
+		thread.join();
+
+	CHECK(mismatches == 0);
+}
+
+static arc::coro<bool> AwaitPublished(arc::context & ctx, const int64_t & n)
+{
+	const std::thread::id thread = std::this_thread::get_id();
+	for (int64_t i = 0; i < n; i++)
+		if (*co_await ctx[Doubled, i] != 2 * i || std::this_thread::get_id() != thread)
+			co_return false;
+	co_return true;
+}
+
+TEST_CASE("Published Results In Place", "[Coro]")
+{
+	{
+		arc::context ctx{ arc::options{ .workerThreadCount = 2 } };
+
+		std::vector<arc::result<const int64_t>> published;
+		for (int64_t i = 0; i < 64; i++)
+			published.push_back(ctx[Doubled, i].active_wait());
+
+		/** The awaiter is not suspended, so it is never resumed on another worker. */
+		CHECK(*ctx[AwaitPublished, 64].active_wait());
+	}
+
+	{
+		gateOpen = false;
+		gateEntered = false;
+
+		arc::context ctx{ arc::options{ .workerThreadCount = 1 } };
+
+		arc::result published = ctx[Doubled, 1].active_wait();
+
+		arc::future gate = ctx[Gate];
+		CHECK(bounded_wait([] { return gateEntered.load(); }));
+
+		/** The only worker is held, a waiter that assisted the scheduler would run pending. */
+		arc::future pending = ctx[Doubled, 2];
+		CHECK(ctx[Doubled, 1].active_wait().get() == published.get());
+		CHECK(!pending.try_wait());
+
+		gateOpen = true;
+		CHECK(*pending.active_wait() == 4);
+		CHECK(*gate.active_wait() == 1);
+	}
+}
+
+static arc::coro<int64_t> DropDoubled(arc::context & ctx, const int64_t & t)
+{
+	int64_t mismatches = 0;
+	for (int64_t n = 0; n < 1000; n++)
+	{
+		int64_t k = (n + t) % 4;
+		if (*co_await ctx[Doubled, k] != 2 * k)
+			mismatches++;
+	}
+	co_return mismatches;
+}
+
+TEST_CASE("Batched Release Revival", "[Coro]")
+{
+	/**
+	 * Without a cache the last reference releases an entry, with one the evictions do. The
+	 * batches are scheduled with high priority, by the workers too.
+	 */
+	for (bool workStealing : { false, true })
+		for (bool lru : { false, true })
+		{
+			arc::context ctx{ arc::options{
+				.workerThreadCount = 4, .lruMaxEntryCount = 2, .workStealing = workStealing } };
+			if (lru)
+				ctx.set_caching_policy_lru(Doubled);
+
+			/**
+			 * The workers drop their references to a few shared keys into the batches of their
+			 * lanes, while other threads revive the same entries before and while those batches
+			 * are released.
+			 */
+			std::vector<arc::future<int64_t>> droppers;
+			for (int64_t t = 0; t < 8; t++)
+				droppers.push_back(ctx[DropDoubled, t]);
+
+			std::atomic_int32_t mismatches = 0;
+			std::vector<std::thread> threads;
+			for (int64_t t = 0; t < 2; t++)
+				threads.emplace_back([&ctx, &mismatches, t] {
+					for (int64_t n = 0; n < 2000; n++)
+					{
+						int64_t k = (n + t) % 4;
+						if (*ctx[Doubled, k].active_wait() != 2 * k)
+							mismatches++;
+					}
+				});
+			for (std::thread & thread : threads)
+				thread.join();
+
+			for (arc::future<int64_t> & dropper : droppers)
+				CHECK(*dropper.active_wait() == 0);
+			CHECK(mismatches == 0);
+		}
+}
+
+static arc::coro<int64_t> Tripled(arc::context & ctx, const int64_t & n) { co_return 3 * n; }
+
+TEST_CASE("Functions Of One Type", "[Coro]")
+{
+	arc::context ctx{ arc::options{ .workerThreadCount = 2 } };
+
+	/** Functions of the same type with the same arguments have entries of their own. */
+	std::vector<std::thread> threads;
+	std::atomic_int32_t mismatches = 0;
+	for (int32_t t = 0; t < 4; t++)
+		threads.emplace_back([&ctx, &mismatches] {
+			for (int64_t n = 0; n < 200; n++)
+			{
+				if (*ctx[Doubled, n].active_wait() != 2 * n)
+					mismatches++;
+				if (*ctx[Tripled, n].active_wait() != 3 * n)
+					mismatches++;
+			}
+		});
+	for (std::thread & thread : threads)
+		thread.join();
+
+	CHECK(mismatches == 0);
+}
+
+static std::atomic_int firstUseComputeCount = 0;
+static std::atomic_int firstUseReadyCount = 0;
+
+static arc::coro<int64_t> FirstUsePositive(arc::context & ctx, const int64_t & n)
+{
+	firstUseComputeCount++;
+	co_return n;
+}
+
+static arc::coro<int64_t> FirstUseNegative(arc::context & ctx, const int64_t & n)
+{
+	firstUseComputeCount++;
+	co_return -n;
+}
+
+TEST_CASE("Concurrent First Use", "[Coro]")
+{
+	firstUseComputeCount = 0;
+	firstUseReadyCount = 0;
+
+	arc::context ctx{ arc::options{ .workerThreadCount = 2 } };
+
+	/**
+	 * The threads race to create the tables of two functions of the same type. A table that lost
+	 * the race would have entries of its own, which would be computed a second time.
+	 */
+	static constexpr int32_t thread_count = 8;
+	static constexpr int64_t key_count = 16;
+	std::vector<std::vector<arc::result<const int64_t>>> results(thread_count);
+	std::vector<std::thread> threads;
+	for (int32_t t = 0; t < thread_count; t++)
+		threads.emplace_back([&ctx, &results, t] {
+			firstUseReadyCount++;
+			CHECK(bounded_wait([] { return firstUseReadyCount == thread_count; }));
+			for (int64_t n = 1; n <= key_count; n++)
+			{
+				results[t].push_back(ctx[FirstUsePositive, n].active_wait());
+				results[t].push_back(ctx[FirstUseNegative, n].active_wait());
+			}
+		});
+	for (std::thread & thread : threads)
+		thread.join();
+
+	CHECK(firstUseComputeCount == 2 * key_count);
+	for (int32_t t = 0; t < thread_count; t++)
+		for (int64_t n = 1; n <= key_count; n++)
+		{
+			const arc::result<const int64_t> & positive = results[t][2 * (n - 1)];
+			const arc::result<const int64_t> & negative = results[t][2 * (n - 1) + 1];
+			CHECK(*positive == n);
+			CHECK(*negative == -n);
+			CHECK(positive.get() == results[0][2 * (n - 1)].get());
+			CHECK(negative.get() == results[0][2 * (n - 1) + 1].get());
+		}
+}
+
+TEST_CASE("Arena Options", "[Coro]")
+{
+	/** Without an arena, with huge pages and with chunks smaller than a slab. */
+	for (const arc::options & options : {
+			 arc::options{ .workerThreadCount = 2, .arenaChunkBytes = 0 },
+			 arc::options{ .workerThreadCount = 2, .arenaHugePages = true },
+			 arc::options{ .workerThreadCount = 2, .arenaChunkBytes = 1 },
+		 })
+	{
+		arc::context ctx{ options };
+		CHECK(*ctx[AwaitChain, 300].active_wait() == 300);
+		/** The key_impl of a long string does not fit inline. */
+		CHECK(*ctx[TwoArgumentsFunction, 1, std::string(200, 'x')].active_wait() ==
+			  std::string(200, 'x') + "1");
+	}
+}
+
 arc::coro<int> f_0(arc::context & ctx) { co_return 0; }
 arc::coro<int> f_1(arc::context & ctx) { co_return 1; }
 
 /**
- * NOTE: A non-coroutine function that returns a coroutine is run under the
- *       context lock in the current implementation.
+ * NOTE: A non-coroutine function that returns a coroutine is run synchronously
+ *       by the thread that requests the result in the current implementation.
  */
 arc::coro<int> f_select(arc::context & ctx, const int64_t & i)
 {
@@ -791,6 +1371,360 @@ TEST_CASE("Global Coro", "[Coro]")
 	ctx.set_caching_policy_global(r);
 }
 
+static std::atomic_int lruComputeCount = 0;
+
+static arc::coro<const int64_t> LruSquare(arc::context & ctx, const int64_t & x)
+{
+	lruComputeCount++;
+	co_return x * x;
+}
+
+TEST_CASE("LRU Coro", "[Coro]")
+{
+	lruComputeCount = 0;
+
+	arc::context ctx{ arc::options{ .workerThreadCount = 2, .lruMaxEntryCount = 2 } };
+	ctx.set_caching_policy_lru(LruSquare);
+
+	CHECK(*ctx[LruSquare, 3].active_wait() == 9);
+
+	/** The released result is retained instead of being computed again. */
+	CHECK(*ctx[LruSquare, 3].active_wait() == 9);
+	CHECK(lruComputeCount == 1);
+
+	/** A single result can also be retained. */
+	arc::result r = ctx[LifetimeTrue].active_wait();
+	ctx.set_caching_policy_lru(r);
+}
+
+static std::atomic_int64_t lruLastDestroyed = 0;
+static std::atomic_int lruDestroyedCount = 0;
+
+/** Reports its destruction, moved-from values do not. */
+struct LruValue
+{
+	LruValue(int64_t value)
+		: value{ value }
+	{}
+
+	LruValue(LruValue && other) noexcept
+		: value{ std::exchange(other.value, 0) }
+	{}
+
+	~LruValue()
+	{
+		if (value)
+		{
+			lruLastDestroyed = value;
+			lruDestroyedCount++;
+		}
+	}
+
+	int64_t value = 0;
+};
+
+namespace arc::util
+{
+	template <>
+	struct memory_usage<LruValue>
+	{
+		size_t operator()(const LruValue & value) const noexcept { return 1000; }
+	};
+}
+
+static arc::coro<LruValue> LruMake(arc::context & ctx, const int64_t & x) { co_return { x }; }
+
+TEST_CASE("LRU Eviction Order", "[Coro]")
+{
+	/** A budget of two entries and a budget of 2500 bytes, each LruValue is charged 1000 bytes. */
+	for (const arc::options & options : {
+			 arc::options{ .workerThreadCount = 1, .lruMaxEntryCount = 2 },
+			 arc::options{ .workerThreadCount = 1, .lruMaxBytes = 2500 },
+		 })
+	{
+		lruLastDestroyed = 0;
+		lruDestroyedCount = 0;
+
+		arc::context ctx{ options };
+		ctx.set_caching_policy_lru(LruMake);
+
+		/** The releases are retained by a task of the worker. */
+		CHECK(ctx[LruMake, 1].active_wait()->value == 1);
+		REQUIRE(drain_worker(ctx));
+		CHECK(ctx[LruMake, 2].active_wait()->value == 2);
+		REQUIRE(drain_worker(ctx));
+
+		/** Using 1 again makes 2 the least recently used entry. */
+		CHECK(ctx[LruMake, 1].active_wait()->value == 1);
+		CHECK(lruDestroyedCount == 0);
+
+		CHECK(ctx[LruMake, 3].active_wait()->value == 3);
+		CHECK(bounded_wait([] { return lruDestroyedCount == 1; }));
+		CHECK(lruLastDestroyed == 2);
+
+		/** Nothing else is evicted. */
+		REQUIRE(drain_worker(ctx));
+		CHECK(lruDestroyedCount == 1);
+	}
+}
+
+static std::atomic_int ttlComputeCount = 0;
+
+static arc::coro<const int64_t> TtlSquare(arc::context & ctx, const int64_t & x)
+{
+	ttlComputeCount++;
+	co_return x * x;
+}
+
+TEST_CASE("TTL Coro", "[Coro]")
+{
+	ttlComputeCount = 0;
+
+	arc::context ctx{ arc::options{ .workerThreadCount = 2 } };
+	ctx.set_caching_policy_ttl(TtlSquare, std::chrono::seconds{ 1 });
+
+	CHECK(*ctx[TtlSquare, 4].active_wait() == 16);
+
+	/** The released result is retained until it expires. */
+	CHECK(*ctx[TtlSquare, 4].active_wait() == 16);
+	CHECK(ttlComputeCount == 1);
+
+	/** A single result can also be retained, it expires while the test is still running. */
+	arc::result r = ctx[LifetimeTrue].active_wait();
+	ctx.set_caching_policy_ttl(r, std::chrono::milliseconds{ 1 });
+}
+
+static std::atomic_int deferredDestroyedCount = 0;
+static std::mutex deferredThreadsMutex;
+/** Guarded by deferredThreadsMutex. The threads the results were destroyed on. */
+static std::vector<std::thread::id> deferredThreads;
+
+template <size_t Size>
+struct DeferredResult
+{
+	DeferredResult() = default;
+	DeferredResult(DeferredResult && other) noexcept
+		: live{ std::exchange(other.live, false) }
+	{}
+	~DeferredResult()
+	{
+		if (!live)
+			return;
+
+		std::lock_guard lk{ deferredThreadsMutex };
+		deferredThreads.push_back(std::this_thread::get_id());
+		deferredDestroyedCount++;
+	}
+
+	bool live = true;
+	std::array<char, Size> bytes{};
+};
+
+static arc::coro<const DeferredResult<4096>> DeferredLarge(arc::context & ctx, const int64_t & i)
+{
+	co_return DeferredResult<4096>{};
+}
+
+/** Small enough to be stored inline, it is moved out of the entry to be deferred. */
+static arc::coro<const DeferredResult<8>> DeferredSmall(arc::context & ctx)
+{
+	co_return DeferredResult<8>{};
+}
+
+static const DeferredResult<4096> deferredReferent;
+
+/** Returns a reference, the entry does not own the result and has nothing to defer. */
+static arc::coro<const DeferredResult<4096> &> DeferredReference(arc::context & ctx)
+{
+	co_return deferredReferent;
+}
+
+static std::atomic_int deferredWorkerCount = 0;
+
+static arc::coro<std::thread::id> DeferredWorkerId(arc::context & ctx, const int64_t & i)
+{
+	/** Held until both workers run one, so the two run on different workers. */
+	deferredWorkerCount++;
+	CHECK(bounded_wait([] { return deferredWorkerCount == 2; }));
+	co_return std::this_thread::get_id();
+}
+
+TEST_CASE("Deferred Destruction Coro", "[Coro]")
+{
+	deferredDestroyedCount = 0;
+	deferredWorkerCount = 0;
+	deferredThreads.clear();
+
+	std::vector<std::thread::id> workers;
+
+	{
+		arc::context ctx{
+			arc::options{ .workerThreadCount = 2, .deferredDestructionBytes = 1024 }
+		};
+
+		arc::future worker0 = ctx[DeferredWorkerId, 0];
+		arc::future worker1 = ctx[DeferredWorkerId, 1];
+		CHECK(bounded_wait([] { return deferredWorkerCount == 2; }));
+		workers.push_back(*worker0.active_wait());
+		workers.push_back(*worker1.active_wait());
+
+		for (int64_t i = 0; i < 8; i++)
+			CHECK(ctx[DeferredLarge, i].active_wait()->live);
+
+		/** Results below the threshold are deferred if their function asks for it. */
+		ctx.set_destruction_policy_deferred(DeferredSmall);
+		CHECK(ctx[DeferredSmall].active_wait()->live);
+
+		ctx.set_destruction_policy_deferred(DeferredReference);
+		CHECK(&*ctx[DeferredReference].active_wait() == &deferredReferent);
+
+		CHECK(bounded_wait([] { return deferredDestroyedCount == 9; }));
+	}
+
+	/** Every deferred result has been destroyed by the time the context is. */
+	CHECK(deferredDestroyedCount == 9);
+	CHECK(deferredReferent.live);
+
+	/** Neither by the thread that dropped them nor by a worker. */
+	CHECK(workers[0] != workers[1]);
+	for (std::thread::id thread : deferredThreads)
+	{
+		CHECK(thread != std::this_thread::get_id());
+		CHECK(thread != workers[0]);
+		CHECK(thread != workers[1]);
+	}
+}
+
+static std::atomic_int storedDestroyedCount = 0;
+
+template <size_t Size, size_t Alignment = alignof(int64_t)>
+struct alignas(Alignment) StoredResult
+{
+	StoredResult(int64_t value)
+		: value{ value }
+	{}
+	StoredResult(StoredResult && other) noexcept
+		: value{ std::exchange(other.value, 0) }
+	{}
+	~StoredResult()
+	{
+		if (value)
+			storedDestroyedCount++;
+	}
+
+	int64_t value = 0;
+	std::array<char, Size - sizeof(int64_t)> bytes{};
+};
+
+template <typename T>
+static arc::coro<const T> Stored(arc::context & ctx, const int64_t & i)
+{
+	co_return T{ i };
+}
+
+TEST_CASE("Inline And Heap Results", "[Coro]")
+{
+	storedDestroyedCount = 0;
+
+	{
+		arc::context ctx{ arc::options{ .workerThreadCount = 2 } };
+
+		/** Fits the buffer of the result_store, is too large and is too strictly aligned for it. */
+		CHECK(ctx[Stored<StoredResult<48>>, 1].active_wait()->value == 1);
+		CHECK(ctx[Stored<StoredResult<56>>, 2].active_wait()->value == 2);
+		CHECK(ctx[Stored<StoredResult<64, 64>>, 3].active_wait()->value == 3);
+
+		/** Every value is destroyed once, when its entry is released. */
+		CHECK(bounded_wait([] { return storedDestroyedCount == 3; }));
+
+		/** An inline value is extracted from its entry and destroyed once by the reclaimer. */
+		ctx.set_destruction_policy_deferred(Stored<StoredResult<48>>);
+		arc::result extracted = ctx[Stored<StoredResult<48>>, 4].active_wait();
+		CHECK(extracted->value == 4);
+		CHECK(reinterpret_cast<std::uintptr_t>(extracted.get()) % alignof(StoredResult<48>) == 0);
+		extracted = {};
+		CHECK(bounded_wait([] { return storedDestroyedCount == 4; }));
+
+		arc::result aligned = ctx[Stored<StoredResult<64, 64>>, 5].active_wait();
+		CHECK(reinterpret_cast<std::uintptr_t>(aligned.get()) % 64 == 0);
+	}
+
+	CHECK(storedDestroyedCount == 5);
+}
+
+static std::atomic_int cancelUnwoundCount = 0;
+
+struct CountUnwound
+{
+	~CountUnwound() { cancelUnwoundCount++; }
+};
+
+static arc::coro<bool> CancelTick(arc::context & ctx, const int64_t & i) { co_return true; }
+
+static arc::coro<bool> CancelSpin(arc::context & ctx)
+{
+	CountUnwound counter;
+
+	/** Only ends by being cancelled. */
+	for (int64_t i = 0; true; i++)
+		co_await ctx[CancelTick, i];
+
+	co_return false;
+}
+
+static arc::coro<bool> CancelParent(arc::context & ctx)
+{
+	CountUnwound counter;
+	co_return !!*co_await ctx[CancelSpin];
+}
+
+TEST_CASE("Cancel Coro", "[Coro]")
+{
+	cancelUnwoundCount = 0;
+
+	arc::context ctx{ arc::options{ .workerThreadCount = 2, .cancelUnreferenced = true } };
+
+	/** Dropping the last reference cancels the computation and what only it references. */
+	ctx[CancelParent];
+
+	CHECK(bounded_wait([] { return cancelUnwoundCount == 2; }));
+
+	/** Other computations are unaffected. */
+	CHECK(*ctx[CancelTick, -1].active_wait());
+}
+
+static std::atomic_int stopTokenExitCount = 0;
+
+static arc::coro<bool> StopTokenLoop(arc::context & ctx)
+{
+	const std::stop_token stopToken = co_await arc::this_coro::stop_token();
+
+	while (!stopToken.stop_requested())
+		co_await ctx.schedule_on_worker_thread();
+
+	stopTokenExitCount++;
+	throw arc::cancelled{};
+}
+
+TEST_CASE("Stop Token Coro", "[Coro]")
+{
+	stopTokenExitCount = 0;
+
+	{
+		arc::context ctx{ arc::options{ .workerThreadCount = 2 } };
+
+		/** Stopped once the result is no longer referenced. */
+		ctx[StopTokenLoop];
+
+		CHECK(bounded_wait([] { return stopTokenExitCount == 1; }));
+
+		/** Stopped when the context shuts down. */
+		ctx.set_caching_policy_global(ctx[StopTokenLoop]);
+	}
+
+	CHECK(stopTokenExitCount == 2);
+}
+
 enum class EnumsWork : int64_t
 {
 	A,
@@ -932,6 +1866,77 @@ TEST_CASE("Timed Schedule", "[Coro]")
 	ctx.schedule_on_main_thread_after([&increment] { increment(2); }, start + 2ms, "increment");
 }
 
+TEST_CASE("Timer Heap Order", "[Coro]")
+{
+	/** The index of each timer in the order they ran. */
+	std::vector<int32_t> ran;
+	std::vector<arc::time_point> timePoints;
+	std::vector<bool> cancelled;
+
+	{
+		arc::context ctx{ {
+			.mainThreadId = std::this_thread::get_id(),
+		} };
+
+		const arc::time_point start = arc::clock::now();
+		std::vector<arc::timer> timers;
+
+		/** Few distinct time points, so that many timers share one. */
+		for (int32_t i = 0; i < 200; i++)
+		{
+			timePoints.push_back(start + std::chrono::microseconds{ (i * 7919) % 13 * 100 });
+			timers.push_back(ctx.schedule_on_main_thread_after(
+				[&ran, i] { ran.push_back(i); }, timePoints.back(), "timer"));
+		}
+
+		/** Cancelled out of the middle of the heap. */
+		for (int32_t i = 0; i < 200; i++)
+		{
+			cancelled.push_back(i % 3 == 1);
+			if (cancelled.back())
+				CHECK(timers[i].cancel());
+		}
+	}
+
+	CHECK(ran.size() == 200 - 67);
+	for (size_t i = 0; i < ran.size(); i++)
+	{
+		CHECK(!cancelled[ran[i]]);
+
+		/** Earlier time points first, the same time point in the order of scheduling. */
+		if (i)
+			CHECK((timePoints[ran[i - 1]] < timePoints[ran[i]] ||
+				   (timePoints[ran[i - 1]] == timePoints[ran[i]] && ran[i - 1] < ran[i])));
+	}
+}
+
+TEST_CASE("Cancel Timer", "[Coro]")
+{
+	int32_t counter = 0;
+
+	arc::util::on_scope_exit _ = [&counter] { CHECK(counter == 2); };
+
+	arc::context ctx{ {
+		.mainThreadId = std::this_thread::get_id(),
+	} };
+
+	arc::time_point start = arc::clock::now();
+
+	using namespace std::chrono_literals;
+
+	ctx.schedule_on_main_thread_after([&counter] { counter++; }, start + 1ms, "increment");
+	arc::timer late =
+		ctx.schedule_on_main_thread_after([&counter] { counter++; }, start + 10s, "late");
+	arc::timer early = ctx.schedule_on_main_thread_after([&counter] { counter++; }, start, "early");
+	ctx.schedule_on_main_thread_after([&counter] { counter++; }, start + 2ms, "increment");
+
+	/** Without cancelling it the context would wait for the late timer and count it. */
+	CHECK(late.cancel());
+	CHECK(!late.cancel());
+	CHECK(early.cancel());
+	CHECK(!arc::timer{}.cancel());
+}
+
 arc::coro<const int> EarlyPublishDemo(arc::context & ctx, const int & val)
 {
 	arc::promise_proxy<const int> promise = co_await arc::get_promise_proxy<const int>();
@@ -3,6 +3,7 @@
 #include <cstdlib>
 #include <filesystem>
 #include <print>
+#include <stop_token>
 #include <vector>
 
 struct CoroFilesystemEntrySize
@@ -41,8 +42,14 @@ static arc::coro<CoroFilesystemEntrySize> get_filesystem_entry_size(
 
 	std::vector<arc::future<CoroFilesystemEntrySize>> subdirs;
 
+	const std::stop_token stopToken = co_await arc::this_coro::stop_token();
+
 	for (const auto & entry : std::filesystem::directory_iterator{ path })
 	{
+		/** Nobody is interested in the size anymore. */
+		if (stopToken.stop_requested())
+			throw arc::cancelled{};
+
 		if (entry.is_directory())
 		{
 			subdirs.emplace_back(ctx[get_filesystem_entry_size, to_key(entry.path())]);